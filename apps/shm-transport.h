@@ -0,0 +1,240 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef __SHM_TRANSPORT_H__
+#define __SHM_TRANSPORT_H__
+
+#include <ndn-cxx/transport/transport.hpp>
+#include <ndn-cxx/transport/unix-transport.hpp>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "core/shm-ring.h"
+
+/*
+ * Transport to the shared-memory face of an emulated node (see ShmPath
+ * in the tutorial). The node hands out a shared memory segment with a
+ * ring per direction and two eventfds over the Unix socket, which then
+ * stays open until the transport is closed.
+ *
+ * When the ring to the node is full, the packet is dropped, as on a
+ * lossy link.
+ */
+class ShmTransport : public ndn::Transport {
+public:
+  explicit
+  ShmTransport (const std::string& path)
+    : m_path (path)
+    , m_txEvent (-1)
+    , m_segment (MAP_FAILED)
+    , m_segmentSize (0)
+  {
+  }
+
+  virtual
+  ~ShmTransport ()
+  {
+    this->close ();
+  }
+
+  virtual void
+  connect (boost::asio::io_service& ioService, const ReceiveCallback& receiveCallback)
+  {
+    ndn::Transport::connect (ioService, receiveCallback);
+
+    m_socket.reset (new boost::asio::local::stream_protocol::socket (ioService));
+    m_socket->connect (boost::asio::local::stream_protocol::endpoint (m_path));
+
+    uint64_t ringSize = 0;
+    int fds[3] = { -1, -1, -1 };
+    this->ReceiveDescriptors (ringSize, fds);
+
+    m_segmentSize = 2 * emulator::ShmRing::GetSize (ringSize);
+    m_segment = ::mmap (0, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    ::close (fds[0]);
+    if (m_segment == MAP_FAILED)
+      {
+        ::close (fds[1]);
+        ::close (fds[2]);
+        throw Error ("[ShmTransport::connect] cannot map shared memory: "
+                     + std::string (std::strerror (errno)));
+      }
+
+    uint8_t* segment = static_cast<uint8_t*> (m_segment);
+    m_txRing.reset (new emulator::ShmRing (segment, ringSize));
+    m_rxRing.reset (new emulator::ShmRing (segment + emulator::ShmRing::GetSize (ringSize),
+                                           ringSize));
+    m_txEvent = fds[1];
+    m_rxEvent.reset (new boost::asio::posix::stream_descriptor (ioService, fds[2]));
+    m_isConnected = true;
+  }
+
+  virtual void
+  close ()
+  {
+    boost::system::error_code error;
+    if (m_rxEvent)
+      m_rxEvent->close (error);
+    if (m_socket)
+      m_socket->close (error);
+    if (m_txEvent >= 0)
+      ::close (m_txEvent);
+    if (m_segment != MAP_FAILED)
+      ::munmap (m_segment, m_segmentSize);
+
+    m_txEvent = -1;
+    m_segment = MAP_FAILED;
+    m_txRing.reset ();
+    m_rxRing.reset ();
+    m_isConnected = false;
+    m_isExpectingData = false;
+  }
+
+  virtual void
+  send (const ndn::Block& wire)
+  {
+    this->Push (wire.wire (), wire.size (), 0, 0);
+  }
+
+  virtual void
+  send (const ndn::Block& header, const ndn::Block& payload)
+  {
+    this->Push (header.wire (), header.size (), payload.wire (), payload.size ());
+  }
+
+  virtual void
+  pause ()
+  {
+    if (m_isExpectingData)
+      {
+        m_isExpectingData = false;
+        m_rxEvent->cancel ();
+      }
+  }
+
+  virtual void
+  resume ()
+  {
+    if (!m_isConnected || m_isExpectingData)
+      return;
+
+    m_isExpectingData = true;
+    this->Receive ();
+  }
+
+private:
+  void
+  ReceiveDescriptors (uint64_t& ringSize, int* fds)
+  {
+    struct iovec iov;
+    iov.iov_base = &ringSize;
+    iov.iov_len = sizeof (ringSize);
+
+    char control[CMSG_SPACE (3 * sizeof (int))];
+    struct msghdr msg;
+    std::memset (&msg, 0, sizeof (msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+
+    if (::recvmsg (m_socket->native_handle (), &msg, MSG_WAITALL)
+        != static_cast<ssize_t> (sizeof (ringSize)))
+      throw Error ("[ShmTransport::connect] handshake failed");
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+    if (cmsg == 0 || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN (3 * sizeof (int)))
+      throw Error ("[ShmTransport::connect] no shared memory in handshake");
+    std::memcpy (fds, CMSG_DATA (cmsg), 3 * sizeof (int));
+  }
+
+  void
+  Push (const uint8_t* first, std::size_t firstLength,
+        const uint8_t* second, std::size_t secondLength)
+  {
+    if (!m_isConnected)
+      throw Error ("[ShmTransport::send] not connected");
+
+    if (!m_txRing->Push (first, firstLength, second, secondLength))
+      return;  // ring full
+
+    if (m_txRing->ShouldNotify ())
+      {
+        uint64_t one = 1;
+        if (::write (m_txEvent, &one, sizeof (one)) < 0)
+          throw Error ("[ShmTransport::send] cannot notify the node: "
+                       + std::string (std::strerror (errno)));
+      }
+  }
+
+  void
+  Receive ()
+  {
+    while (m_isExpectingData)
+      {
+        std::size_t length;
+        const uint8_t* data = m_rxRing->Front (length);
+        if (data == 0)
+          {
+            if (m_rxRing->PrepareToWait ())
+              {
+                m_rxEvent->async_read_some (boost::asio::null_buffers (),
+                                            boost::bind (&ShmTransport::HandleNotify, this, _1));
+                return;
+              }
+            continue;
+          }
+
+        // Copy the packet out, the node reuses its slot
+        ndn::Block element;
+        bool isOk = ndn::Block::fromBuffer (data, length, element);
+        m_rxRing->Pop ();
+        if (isOk)
+          m_receiveCallback (element);
+      }
+  }
+
+  void
+  HandleNotify (const boost::system::error_code& error)
+  {
+    if (error)
+      return;  // paused or closed
+
+    uint64_t count;
+    if (::read (m_rxEvent->native_handle (), &count, sizeof (count)) < 0 && errno != EAGAIN)
+      throw Error ("[ShmTransport::HandleNotify] cannot read eventfd: "
+                   + std::string (std::strerror (errno)));
+
+    this->Receive ();
+  }
+
+private:
+  const std::string m_path;
+  boost::scoped_ptr<boost::asio::local::stream_protocol::socket> m_socket;
+  boost::scoped_ptr<boost::asio::posix::stream_descriptor> m_rxEvent;  // from the node
+  int m_txEvent;  // to the node
+  void* m_segment;
+  std::size_t m_segmentSize;
+  boost::scoped_ptr<emulator::ShmRing> m_txRing;
+  boost::scoped_ptr<emulator::ShmRing> m_rxRing;
+};
+
+// Transport for the path given on the command line of the apps.
+// "shm:<path>" selects the shared-memory transport.
+inline ndn::shared_ptr<ndn::Transport>
+MakeTransport (const std::string& path)
+{
+  if (path.compare (0, 4, "shm:") == 0)
+    return ndn::make_shared<ShmTransport> (path.substr (4));
+  else
+    return ndn::make_shared<ndn::UnixTransport> (path);
+}
+
+#endif // __SHM_TRANSPORT_H__
@@ -1,16 +1,17 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
-#include <ndn-cxx/transport/unix-transport.hpp>
 #include <ndn-cxx/face.hpp>
 #include <ndn-cxx/util/scheduler.hpp>
 
+#include "shm-transport.h"
+
 class SimpleConsumer {
 public:
   SimpleConsumer (long delay, const std::string& name, const std::string& path)
     : m_delay (delay)
     , m_name (name)
     , m_path (path)
-    , m_transport (ndn::make_shared<ndn::UnixTransport> (path))
+    , m_transport (MakeTransport (path))
     , m_face (m_transport, m_ioService)
     , m_scheduler (m_ioService)
   {
@@ -60,7 +61,7 @@ private:
   long m_delay;
   const ndn::Name m_name;
   const std::string m_path;
-  ndn::shared_ptr<ndn::UnixTransport> m_transport;
+  ndn::shared_ptr<ndn::Transport> m_transport;
   boost::asio::io_service m_ioService;
   ndn::Face m_face;
   ndn::Scheduler m_scheduler;
@@ -1,10 +1,11 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
-#include <ndn-cxx/transport/unix-transport.hpp>
 #include <ndn-cxx/face.hpp>
 #include <ndn-cxx/security/key-chain.hpp>
 #include <iostream>
 
+#include "shm-transport.h"
+
 using namespace ndn;
 
 class SimpleProducer
@@ -13,7 +14,7 @@ public:
   SimpleProducer (const std::string& name, const std::string& path)
     : m_name (name)
     , m_path (path)
-    , m_transport (ndn::make_shared<ndn::UnixTransport> (path))
+    , m_transport (MakeTransport (path))
     , m_face (m_transport, m_ioService)
   {
   }
@@ -65,7 +66,7 @@ public:
 private:
   const std::string m_name;
   const std::string m_path;
-  shared_ptr<ndn::UnixTransport> m_transport;
+  shared_ptr<ndn::Transport> m_transport;
   boost::asio::io_service m_ioService;
   Face m_face;
   KeyChain m_keyChain;
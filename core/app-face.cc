@@ -1,60 +1,198 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
 #include "app-face.h"
+#include "io-uring.h"
 #include "node.h"
 
 namespace emulator {
 
+const std::size_t AppFace::SEND_QUEUE_LIMIT = 1024;
+const std::size_t AppFace::MAX_SEND_BATCH = 64;
+const std::size_t AppFace::RECEIVE_CHUNK_SIZE = 4096;
+
 void
-AppFace::HandleReceive (const boost::system::error_code& error,
-			std::size_t nBytesReceived)
+AppFace::Send (boost::shared_ptr<Packet>& pkt)
 {
-  if (!error)
+  if (m_sendQueue.size () >= SEND_QUEUE_LIMIT)
+    {
+      // The app does not keep up. Drop tail as the link devices do, and
+      // let the consumer retransmit.
+      NDNEM_LOG_INFO ("[AppFace::Send] (" << m_nodeId << ":" << m_id
+                      << ") reached max queue size. Drop tail");
+      return;
+    }
+
+  m_sendQueue.push_back (pkt);
+  if (m_sending.empty ())
+    this->StartSend ();
+}
+
+void
+AppFace::StartSend ()
+{
+  // Gather the queued packets into a single write. async_write takes care
+  // of partial writes, and with one write in flight at a time the packets
+  // cannot interleave on the stream.
+  while (!m_sendQueue.empty () && m_sending.size () < MAX_SEND_BATCH)
+    {
+      m_sending.push_back (m_sendQueue.front ());
+      m_sendQueue.pop_front ();
+    }
+
+#ifdef NDNEM_HAVE_IO_URING
+  if (m_ioUring != 0)
     {
-      // Try to parse message data
-      m_inputBufferSize += nBytesReceived;
+      this->StartUringSend ();
+      return;
+    }
+#endif
+
+  for (std::size_t i = 0; i < m_sending.size (); i++)
+    {
+      m_sendBuffers.push_back (boost::asio::buffer (m_sending[i]->GetBytes (),
+                                                    m_sending[i]->GetLength ()));
+    }
 
-      std::size_t offset = 0;
+  boost::asio::async_write (m_socket, m_sendBuffers,
+                            m_strand.wrap (boost::bind (&AppFace::HandleSend,
+                                                        this->shared_from_this (), _1, _2)));
+}
+
+void
+AppFace::HandleSend (const boost::system::error_code& error, std::size_t)
+{
+  m_sending.clear ();
+  m_sendBuffers.clear ();
 
-      bool isOk = true;
+  if (error)
+    {
+      NDNEM_LOG_ERROR ("[AppFace::HandleSend] (" << m_nodeId
+                       << ":" << m_id << ") error = " << error.message ());
+      //TODO: close face
+      m_sendQueue.clear ();
+      return;
+    }
+
+  if (!m_sendQueue.empty ())
+    this->StartSend ();
+}
+
+// Size of the packet at the start of the unparsed bytes, or 0 if
+// its TLV header has not been received yet
+std::size_t
+AppFace::GetPendingPacketSize () const
+{
+  ndn::Buffer::const_iterator begin = m_inputBuffer->begin () + m_inputBegin;
+  ndn::Buffer::const_iterator it = begin;
+  ndn::Buffer::const_iterator end = m_inputBuffer->begin () + m_inputEnd;
+  try
+    {
+      ndn::Tlv::readType (it, end);
+      uint64_t length = ndn::Tlv::readVarNumber (it, end);
+      return (it - begin) + length;
+    }
+  catch (ndn::Tlv::Error&)
+    {
+      return 0;
+    }
+}
+
+// Make room after the received bytes for the given number of bytes,
+// and at least for the rest of a partial packet
+void
+AppFace::ReserveInput (std::size_t length)
+{
+  std::size_t pending = m_inputEnd - m_inputBegin;
+  std::size_t needed = length;
+  if (pending > 0)
+    {
+      std::size_t size = this->GetPendingPacketSize ();
+      if (size > ndn::MAX_NDN_PACKET_SIZE)
+        throw std::runtime_error ("Incoming packet too large to process");
+      if (size > pending)
+        needed = std::max (needed, size - pending);
+    }
+
+  if (!m_inputBuffer || m_inputEnd + needed > m_inputBuffer->size ())
+    {
+      // Start a new buffer with the partial packet, if any. Only the
+      // bytes of that packet are copied. A buffer no longer shared
+      // with any block is reused, otherwise it is left to the blocks.
+      std::size_t size = std::max (RECEIVE_CHUNK_SIZE, pending + needed);
+      if (!m_inputBuffer || !m_inputBuffer.unique () || m_inputBuffer->size () < size)
+        {
+          ndn::BufferPtr buffer (ndn::make_shared<ndn::Buffer> (size));
+          if (pending > 0)
+            std::copy (m_inputBuffer->begin () + m_inputBegin,
+                       m_inputBuffer->begin () + m_inputEnd, buffer->begin ());
+          m_inputBuffer = buffer;
+        }
+      else if (pending > 0)
+        std::copy (m_inputBuffer->begin () + m_inputBegin,
+                   m_inputBuffer->begin () + m_inputEnd, m_inputBuffer->begin ());
+
+      m_inputBegin = 0;
+      m_inputEnd = pending;
+    }
+}
+
+// Hand the complete packets received so far to the node
+void
+AppFace::ParseInput ()
+{
+  // Parse the packets in place
+  while (m_inputBegin < m_inputEnd)
+    {
       ndn::Block element;
-      while (m_inputBufferSize - offset > 0)
-	{
-	  isOk = ndn::Block::fromBuffer (m_inputBuffer + offset, m_inputBufferSize - offset, element);
-	  if (!isOk)
-	    break;
-
-	  offset += element.size();
-
-	  // Pass message to the node
-	  this->Dispatch (element);
-	}
-
-      if (!isOk && m_inputBufferSize == ndn::MAX_NDN_PACKET_SIZE && offset == 0)
-	{
-	  throw std::runtime_error ("Incoming packet too large to process");
-	}
-
-      if (offset > 0)
-	{
-	  if (offset != m_inputBufferSize)
-	    {
-	      std::copy (m_inputBuffer + offset, m_inputBuffer + m_inputBufferSize,
-			 m_inputBuffer);
-	      m_inputBufferSize -= offset;
-	    }
-	  else
-	    {
-	      m_inputBufferSize = 0;
-	    }
-	}
-
-      m_socket.async_receive (boost::asio::buffer (m_inputBuffer + m_inputBufferSize,
-						   ndn::MAX_NDN_PACKET_SIZE - m_inputBufferSize), 0,
-			      boost::bind (&AppFace::HandleReceive, this, _1, _2));
-
-    }
-  else
+      // The buffer may hold stale bytes after the received ones
+      if (!ndn::Block::fromBuffer (m_inputBuffer, m_inputBegin, element)
+          || element.size () > m_inputEnd - m_inputBegin)
+        break;
+
+      m_inputBegin += element.size ();
+
+      // Pass message to the node
+      this->Dispatch (element);
+    }
+
+  if (m_inputBegin == m_inputEnd && m_inputBuffer.unique ())
+    {
+      // Rewind the buffer when nothing refers to it anymore
+      m_inputBegin = 0;
+      m_inputEnd = 0;
+    }
+}
+
+void
+AppFace::StartReceive ()
+{
+  if (m_isClosed)
+    return;
+
+  // Receive at least a quarter of a chunk, so that reads are worth it
+  this->ReserveInput (RECEIVE_CHUNK_SIZE / 4);
+
+  m_socket.async_receive (boost::asio::buffer (&(*m_inputBuffer)[m_inputEnd],
+                                               m_inputBuffer->size () - m_inputEnd), 0,
+                          m_strand.wrap (boost::bind (&AppFace::HandleReceive,
+                                                      this->shared_from_this (), _1, _2)));
+}
+
+void
+AppFace::HandleReceive (const boost::system::error_code& error,
+			std::size_t nBytesReceived)
+{
+  if (!error)
+    {
+      m_inputEnd += nBytesReceived;
+      this->ParseInput ();
+      this->StartReceive ();
+    }
+  else if (!m_isClosed)
     {
       NDNEM_LOG_TRACE ("[AppFace::HandleReceive] (" << m_nodeId
                        << ":" << m_id << ") error = " << error.message ());
@@ -62,4 +200,135 @@ AppFace::HandleReceive (const boost::system::error_code& error,
     }
 }
 
+void
+AppFace::Close ()
+{
+  m_isClosed = true;
+  if (m_ioUring == 0)
+    {
+      // The handlers own the face. Have the pending receive complete.
+      boost::system::error_code error;
+      m_socket.cancel (error);
+      return;
+    }
+
+#ifdef NDNEM_HAVE_IO_URING
+  if (m_receiveRequest != 0)
+    {
+      m_ioUring->Cancel (m_receiveRequest);
+      m_receiveRequest = 0;
+    }
+#endif
+}
+
+#ifdef NDNEM_HAVE_IO_URING
+
+void
+AppFace::Start (IoUring* ioUring)
+{
+  m_ioUring = ioUring;
+  std::memset (&m_sendMessage, 0, sizeof (m_sendMessage));
+  this->StartUringReceive ();
+}
+
+void
+AppFace::StartUringSend ()
+{
+  m_sendIovecs.resize (m_sending.size ());
+  for (std::size_t i = 0; i < m_sending.size (); i++)
+    {
+      m_sendIovecs[i].iov_base = const_cast<uint8_t*> (m_sending[i]->GetBytes ());
+      m_sendIovecs[i].iov_len = m_sending[i]->GetLength ();
+    }
+  m_sendMessage.msg_iov = &m_sendIovecs[0];
+  m_sendMessage.msg_iovlen = m_sendIovecs.size ();
+
+  m_ioUring->SendMsg (m_socket.native_handle (), &m_sendMessage,
+                      m_strand.wrap (boost::bind (&AppFace::HandleUringSend,
+                                                  this->shared_from_this (), _1, _2)));
+}
+
+void
+AppFace::HandleUringSend (int result, unsigned)
+{
+  if (result > 0)
+    {
+      // Skip what was written, in case the write was short
+      std::size_t written = result;
+      while (m_sendMessage.msg_iovlen > 0 && written >= m_sendMessage.msg_iov->iov_len)
+        {
+          written -= m_sendMessage.msg_iov->iov_len;
+          m_sendMessage.msg_iov++;
+          m_sendMessage.msg_iovlen--;
+        }
+
+      if (m_sendMessage.msg_iovlen > 0)
+        {
+          m_sendMessage.msg_iov->iov_base =
+            static_cast<uint8_t*> (m_sendMessage.msg_iov->iov_base) + written;
+          m_sendMessage.msg_iov->iov_len -= written;
+          m_ioUring->SendMsg (m_socket.native_handle (), &m_sendMessage,
+                              m_strand.wrap (boost::bind (&AppFace::HandleUringSend,
+                                                          this->shared_from_this (), _1, _2)));
+          return;
+        }
+    }
+
+  boost::system::error_code error;
+  if (result < 0)
+    error = boost::system::error_code (-result, boost::system::system_category ());
+  this->HandleSend (error, std::max (result, 0));
+}
+
+void
+AppFace::StartUringReceive ()
+{
+  if (m_isClosed)
+    return;
+
+  m_receiveRequest =
+    m_ioUring->Receive (m_socket.native_handle (),
+                        m_strand.wrap (boost::bind (&AppFace::HandleUringReceive,
+                                                    this->shared_from_this (), _1, _2)));
+}
+
+void
+AppFace::HandleUringReceive (int result, unsigned flags)
+{
+  if (!(flags & IORING_CQE_F_MORE))
+    m_receiveRequest = 0;
+
+  if (result > 0)
+    {
+      // Copy the bytes out, so that the buffer goes back to the kernel
+      uint16_t bufferId = IoUring::GetBufferId (flags);
+      this->ReserveInput (result);
+      std::memcpy (&(*m_inputBuffer)[m_inputEnd], m_ioUring->GetBuffer (bufferId), result);
+      m_ioUring->ReleaseBuffer (bufferId);
+      m_inputEnd += result;
+      this->ParseInput ();
+
+      // The kernel may end a multishot receive at any time
+      if (!(flags & IORING_CQE_F_MORE))
+        this->StartUringReceive ();
+    }
+  else if (result == -ENOBUFS)
+    {
+      NDNEM_LOG_DEBUG ("[AppFace::HandleUringReceive] (" << m_nodeId
+                       << ":" << m_id << ") out of receive buffers");
+      // Retry once the handlers of other receives give a buffer back
+      m_ioUring->WaitForBuffer (m_strand.wrap (boost::bind (&AppFace::StartUringReceive,
+                                                            this->shared_from_this ())));
+    }
+  else if (result != -ECANCELED)
+    {
+      NDNEM_LOG_TRACE ("[AppFace::HandleUringReceive] (" << m_nodeId << ":" << m_id
+                       << ") error = " << (result == 0 ? "end of file"
+                                           : std::strerror (-result)));
+      m_node->RemoveFace (m_id);
+    }
+}
+
+#endif // NDNEM_HAVE_IO_URING
+
 } // namespace emulator
@@ -7,19 +7,38 @@
 
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
 #include <boost/utility.hpp>
+#include <deque>
+#include <sys/socket.h>
+#include <vector>
 
 namespace emulator {
 
-class AppFace : public Face {
+class IoUring;
+
+/*
+ * Face to a local app over a Unix socket. The socket is driven either by
+ * asio or, with --io-uring, by the io_uring of the node. In both cases
+ * the pending requests keep the face alive until they complete.
+ */
+class AppFace : public Face, public boost::enable_shared_from_this<AppFace> {
 public:
+  static const std::size_t SEND_QUEUE_LIMIT;  // in packets
+  static const std::size_t MAX_SEND_BATCH;  // packets per write
+  static const std::size_t RECEIVE_CHUNK_SIZE;  // in bytes
+
   AppFace (const int faceId, boost::shared_ptr<Node> node,
            boost::asio::io_service& ioService)
     : Face (faceId, node, ioService)
     , m_socket (ioService)
-    , m_inputBufferSize (0)
+    , m_inputBegin (0)
+    , m_inputEnd (0)
+    , m_ioUring (0)
+    , m_receiveRequest (0)
+    , m_isClosed (false)
   {
   }
 
@@ -40,39 +59,81 @@ public:
   void
   Start ()
   {
-    m_socket.async_receive (boost::asio::buffer (m_inputBuffer, ndn::MAX_NDN_PACKET_SIZE), 0,
-                            boost::bind (&AppFace::HandleReceive, this, _1, _2));
+    this->StartReceive ();
   }
 
-  virtual void
-  Send (boost::shared_ptr<Packet>& pkt)
+  // Drive the socket with io_uring. Only with NDNEM_HAVE_IO_URING.
+  void
+  Start (IoUring* ioUring);
+
+  virtual bool
+  IsLocal () const
   {
-    const uint8_t* data = pkt->GetBytes ();
-    std::size_t length = pkt->GetLength ();
-    m_socket.async_send (boost::asio::buffer (data, length),
-                         boost::bind (&AppFace::HandleSend, this, _1, _2));
+    return true;
   }
 
+  // Queue the packet for the app. Packets queued while a write is in
+  // progress are sent together in the next write.
+  virtual void
+  Send (boost::shared_ptr<Packet>& pkt);
+
+  // Cancel the pending receive, whose handler keeps the face alive
+  virtual void
+  Close ();
+
 private:
   void
-  HandleSend (const boost::system::error_code& error, std::size_t nBytesTransforred)
-  {
-    if (error)
-      {
-        NDNEM_LOG_ERROR ("[AppFace::HandleSend] (" << m_nodeId
-                         << ":" << m_id << ") error = " << error.message ());
-        //TODO: close face
-      }
-  }
-  
+  StartSend ();
+
+  void
+  HandleSend (const boost::system::error_code&, std::size_t);
+
+  std::size_t
+  GetPendingPacketSize () const;
+
+  void
+  ReserveInput (std::size_t length);
+
+  void
+  ParseInput ();
+
+  void
+  StartReceive ();
+
   void
   HandleReceive (const boost::system::error_code& error,
                  std::size_t nBytesReceived);
 
+  void
+  StartUringSend ();
+
+  void
+  HandleUringSend (int result, unsigned flags);
+
+  void
+  StartUringReceive ();
+
+  void
+  HandleUringReceive (int result, unsigned flags);
+
 private:
   boost::asio::local::stream_protocol::socket m_socket; // receive socket
-  uint8_t m_inputBuffer[ndn::MAX_NDN_PACKET_SIZE]; // receive buffer
-  std::size_t m_inputBufferSize;
+  // Receive buffer. Packets are parsed in place and handed to the node
+  // as blocks sharing the buffer, so a buffer is never moved or reused
+  // while a block may still refer to it.
+  ndn::BufferPtr m_inputBuffer;
+  std::size_t m_inputBegin;  // first byte not parsed yet
+  std::size_t m_inputEnd;  // end of the received bytes
+
+  std::deque<boost::shared_ptr<Packet> > m_sendQueue;  // waiting for the next write
+  std::vector<boost::shared_ptr<Packet> > m_sending;  // in the current write
+  std::vector<boost::asio::const_buffer> m_sendBuffers;
+
+  IoUring* m_ioUring;  // 0 with asio
+  uint64_t m_receiveRequest;  // multishot receive, 0 if none
+  bool m_isClosed;
+  std::vector<struct iovec> m_sendIovecs;  // current write, with io_uring
+  struct msghdr m_sendMessage;
 };
 
 } // namespace emulator
@@ -0,0 +1,64 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <stdexcept>
+
+#include "cache-admission.h"
+
+namespace emulator {
+namespace node {
+
+const double CacheAdmission::TARGET_WINDOW = 10.0;
+
+CacheAdmission::CacheAdmission (const std::string& policy, double probability)
+  : m_name (policy)
+  , m_probability (probability)
+{
+  if (policy == "always")
+    m_type = ALWAYS;
+  else if (policy == "lcd")
+    m_type = LCD;
+  else if (policy == "prob")
+    m_type = PROB;
+  else if (policy == "probcache")
+    m_type = PROBCACHE;
+  else if (policy == "edge")
+    m_type = EDGE;
+  else
+    throw std::invalid_argument ("[CacheAdmission::CacheAdmission] unknown cache admission "
+                                 + policy);
+
+  if (m_probability < 0.0 || m_probability > 1.0)
+    throw std::invalid_argument ("[CacheAdmission::CacheAdmission] invalid cache probability");
+}
+
+bool
+CacheAdmission::Admit (int hopCount, int pathLength, bool isEdge)
+{
+  switch (m_type)
+    {
+    case ALWAYS:
+      return true;
+    case LCD:
+      return hopCount == 1;
+    case PROB:
+      return this->Toss (m_probability);
+    case PROBCACHE:
+      {
+        if (hopCount <= 0 || pathLength <= 0)
+          return false;
+
+        // TimesIn: room left on the rest of the path, relative to the target
+        // window. CacheWeight: fraction of the path already traveled.
+        double timesIn = (pathLength - hopCount + 1) / TARGET_WINDOW;
+        double cacheWeight = static_cast<double> (hopCount) / pathLength;
+        return this->Toss (timesIn * cacheWeight);
+      }
+    case EDGE:
+      return isEdge;
+    default:
+      return true;
+    }
+}
+
+} // namespace node
+} // namespace emulator
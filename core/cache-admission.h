@@ -0,0 +1,65 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __CACHE_ADMISSION_H__
+#define __CACHE_ADMISSION_H__
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <string>
+
+namespace emulator {
+namespace node {
+
+/*
+ * Decides whether a node caches the Data it forwards. The decision is
+ * based on the position of the node on the path of the Data:
+ *
+ * - always: cache everything (default)
+ * - lcd: leave copy down, cache only one hop below the node that served
+ *   the Data, so that popular content moves towards the consumers
+ * - prob: cache with a fixed probability
+ * - probcache: cache with a probability that grows towards the consumer
+ *   and with the length of the path (ProbCache, Psaras et al. 2012),
+ *   assuming all caches on the path have the same size
+ * - edge: cache only on nodes with a consumer among the downstream faces
+ */
+class CacheAdmission {
+public:
+  // ProbCache target time window, in units of the cache size
+  static const double TARGET_WINDOW;
+
+  CacheAdmission (const std::string& policy, double probability);
+
+  const std::string&
+  GetName () const
+  {
+    return m_name;
+  }
+
+  // hopCount is the number of links the Data has crossed since the node
+  // that served it, and pathLength the number of links between that node
+  // and the consumer. isEdge tells whether the Data goes to a local app.
+  bool
+  Admit (int hopCount, int pathLength, bool isEdge);
+
+private:
+  bool
+  Toss (double p)
+  {
+    return m_uniform (m_engine) < p;
+  }
+
+private:
+  enum Type { ALWAYS, LCD, PROB, PROBCACHE, EDGE };
+
+  const std::string m_name;
+  Type m_type;
+  const double m_probability;  // used by prob
+  boost::random::mt19937 m_engine;
+  boost::random::uniform_01<double> m_uniform;
+};
+
+} // namespace node
+} // namespace emulator
+
+#endif // __CACHE_ADMISSION_H__
@@ -0,0 +1,151 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/assert.hpp>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+
+#include "logging.h"
+#include "cache-log.h"
+
+namespace emulator {
+namespace node {
+
+static const char LOG_MAGIC[8] = { 'N', 'D', 'N', 'E', 'M', 'C', 'S', '1' };
+static const uint32_t RECORD_LIVE = 0x4c495645;
+static const uint32_t RECORD_ERASED = 0x44454144;
+
+const std::size_t CacheLog::HEADER_SIZE = 16;  // magic and tail offset
+const std::size_t CacheLog::RECORD_HEADER_SIZE = 16;
+
+// Make sure the file exists with the given size. A file
+// with another size is started over.
+static const char*
+PrepareFile (const std::string& path, std::size_t capacity)
+{
+  boost::system::error_code error;
+  if (boost::filesystem::file_size (path, error) != capacity || error)
+    {
+      std::ofstream (path.c_str (), std::ios::binary | std::ios::trunc);
+      boost::filesystem::resize_file (path, capacity);
+    }
+  return path.c_str ();
+}
+
+CacheLog::CacheLog (const std::string& path, std::size_t capacity)
+  : m_file (PrepareFile (path, capacity), boost::interprocess::read_write)
+  , m_region (m_file, boost::interprocess::read_write)
+  , m_base (static_cast<uint8_t*> (m_region.get_address ()))
+  , m_capacity (capacity)
+  , m_erasedSize (0)
+{
+  if (std::memcmp (m_base, LOG_MAGIC, sizeof (LOG_MAGIC)) != 0
+      || Tail () < HEADER_SIZE || Tail () > m_capacity)
+    {
+      NDNEM_LOG_INFO ("[CacheLog::CacheLog] create new cache log " << path);
+      std::memcpy (m_base, LOG_MAGIC, sizeof (LOG_MAGIC));
+      Tail () = HEADER_SIZE;
+      return;
+    }
+
+  // Drop the records after the first damaged one, e.g.,
+  // when the emulator was killed in the middle of a write
+  std::size_t offset = HEADER_SIZE;
+  while (offset < Tail ())
+    {
+      RecordHeader* header = this->GetHeader (offset);
+      if (offset + RECORD_HEADER_SIZE > Tail ()
+          || (header->state != RECORD_LIVE && header->state != RECORD_ERASED)
+          || offset + GetRecordSize (header->length) > Tail ())
+        break;
+
+      if (header->state == RECORD_ERASED)
+        m_erasedSize += GetRecordSize (header->length);
+      offset += GetRecordSize (header->length);
+    }
+  Tail () = offset;
+}
+
+void
+CacheLog::GetRecords (std::vector<Record>& out) const
+{
+  std::size_t offset = HEADER_SIZE;
+  while (offset < Tail ())
+    {
+      RecordHeader* header = this->GetHeader (offset);
+      if (header->state == RECORD_LIVE)
+        {
+          Record r = { offset, header->expire };
+          out.push_back (r);
+        }
+      offset += GetRecordSize (header->length);
+    }
+}
+
+bool
+CacheLog::Append (const ndn::Block& wire, int64_t expire, std::size_t& offset)
+{
+  std::size_t size = GetRecordSize (wire.size ());
+  if (Tail () + size > m_capacity)
+    return false;
+
+  offset = Tail ();
+  RecordHeader* header = this->GetHeader (offset);
+  header->length = wire.size ();
+  header->expire = expire;
+  std::memcpy (m_base + offset + RECORD_HEADER_SIZE, wire.wire (), wire.size ());
+  // Publish the record only when it is complete
+  header->state = RECORD_LIVE;
+  Tail () = offset + size;
+  return true;
+}
+
+void
+CacheLog::Update (std::size_t offset, const ndn::Block& wire, int64_t expire)
+{
+  RecordHeader* header = this->GetHeader (offset);
+  BOOST_ASSERT (header->length == wire.size ());
+  header->expire = expire;
+  std::memcpy (m_base + offset + RECORD_HEADER_SIZE, wire.wire (), wire.size ());
+}
+
+void
+CacheLog::Erase (std::size_t offset)
+{
+  RecordHeader* header = this->GetHeader (offset);
+  header->state = RECORD_ERASED;
+  m_erasedSize += GetRecordSize (header->length);
+}
+
+ndn::Block
+CacheLog::Read (std::size_t offset) const
+{
+  RecordHeader* header = this->GetHeader (offset);
+  return ndn::Block (m_base + offset + RECORD_HEADER_SIZE, header->length);
+}
+
+void
+CacheLog::Compact (std::vector<std::pair<std::size_t, std::size_t> >& moves)
+{
+  std::size_t from = HEADER_SIZE;
+  std::size_t to = HEADER_SIZE;
+  while (from < Tail ())
+    {
+      RecordHeader* header = this->GetHeader (from);
+      std::size_t size = GetRecordSize (header->length);
+      if (header->state == RECORD_LIVE)
+        {
+          if (from != to)
+            std::memmove (m_base + to, m_base + from, size);
+          moves.push_back (std::make_pair (from, to));
+          to += size;
+        }
+      from += size;
+    }
+
+  Tail () = to;
+  m_erasedSize = 0;
+}
+
+} // namespace node
+} // namespace emulator
@@ -0,0 +1,108 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __CACHE_LOG_H__
+#define __CACHE_LOG_H__
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/utility.hpp>
+#include <ndn-cxx/encoding/block.hpp>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace emulator {
+namespace node {
+
+/*
+ * Append-only log of wire-encoded Data packets in a memory-mapped file,
+ * used as the storage of the content store. The packets stay in the page
+ * cache rather than on the heap, and the log survives the emulator, so
+ * that the next run can start with a warm cache.
+ *
+ * Each record holds the state of the record (live or erased), the expiry
+ * time of the data and its wire encoding. Erased records are reclaimed by
+ * compacting the log, which moves the live records to the front.
+ */
+class CacheLog : boost::noncopyable {
+public:
+  static const std::size_t HEADER_SIZE;  // log header
+  static const std::size_t RECORD_HEADER_SIZE;
+
+  struct Record {
+    std::size_t offset;
+    int64_t expire;  // us since the epoch of the system clock
+  };
+
+  // Open the log in the file, or create it if it does not exist or has
+  // a different capacity
+  CacheLog (const std::string& path, std::size_t capacity);
+
+  // Live records in the log, in the order they were appended
+  void
+  GetRecords (std::vector<Record>&) const;
+
+  // Return false if there is no room left
+  bool
+  Append (const ndn::Block&, int64_t, std::size_t&);
+
+  // Overwrite a record with data of the same size
+  void
+  Update (std::size_t, const ndn::Block&, int64_t);
+
+  void
+  Erase (std::size_t);
+
+  ndn::Block
+  Read (std::size_t) const;
+
+  // Bytes taken by erased records
+  std::size_t
+  GetErasedSize () const
+  {
+    return m_erasedSize;
+  }
+
+  // Move the live records to the front of the log. Returns the (old, new)
+  // offsets of the live records in increasing order.
+  void
+  Compact (std::vector<std::pair<std::size_t, std::size_t> >&);
+
+private:
+  struct RecordHeader {
+    uint32_t state;
+    uint32_t length;  // of the wire encoding
+    int64_t expire;
+  };
+
+  RecordHeader*
+  GetHeader (std::size_t offset) const
+  {
+    return reinterpret_cast<RecordHeader*> (m_base + offset);
+  }
+
+  static std::size_t
+  GetRecordSize (std::size_t length)
+  {
+    return (RECORD_HEADER_SIZE + length + 7) & ~static_cast<std::size_t> (7);
+  }
+
+  uint64_t&
+  Tail () const
+  {
+    return *reinterpret_cast<uint64_t*> (m_base + 8);
+  }
+
+private:
+  boost::interprocess::file_mapping m_file;
+  boost::interprocess::mapped_region m_region;
+  uint8_t* m_base;
+  const std::size_t m_capacity;
+  std::size_t m_erasedSize;
+};
+
+} // namespace node
+} // namespace emulator
+
+#endif // __CACHE_LOG_H__
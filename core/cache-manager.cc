@@ -1,96 +1,301 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
+#include <boost/make_shared.hpp>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
 #include "cache-manager.h"
 
 namespace emulator {
 namespace node {
 
-const boost::posix_time::time_duration CacheManager::CACHE_PURGE_INTERVAL =
-  boost::posix_time::milliseconds (3600000);  // 1 h
+// Expiry time as stored in the cache log
+static int64_t
+GetLogTime (const boost::chrono::system_clock::time_point& t)
+{
+  return boost::chrono::duration_cast<boost::chrono::microseconds> (t.time_since_epoch ()).count ();
+}
+
+CacheManager::CacheManager (const std::string& nodeId, std::size_t limit, const std::string& policy,
+                            const std::string& logPath,
+                            Scheduler& scheduler, boost::asio::io_service::strand& strand)
+  : m_nodeId (nodeId)
+  , m_scheduler (scheduler)
+  , m_policy (CachePolicy::Create (policy, limit))
+  , m_count (0)
+  , m_limit (limit)
+  , m_cleanupTimer (scheduler, strand)
+  , m_isCleanUpScheduled (false)
+{
+  // The log and the ARC policy take twice the limit
+  if (limit > std::numeric_limits<std::size_t>::max () / 2)
+    throw std::invalid_argument ("[CacheManager::CacheManager] cache limit too large");
+
+  if (!logPath.empty ())
+    {
+      // Leave room for the record headers and the erased records
+      // that have not been compacted yet
+      m_log = boost::make_shared<CacheLog> (logPath, 2 * limit);
+      this->LoadLog ();
+    }
+}
 
 bool
-CacheManager::FindMatchingData (const boost::shared_ptr<ndn::Interest>& i,
-                                boost::shared_ptr<ndn::Data>& out)
+CacheManager::FindMatchingData (const boost::shared_ptr<InterestView>& i,
+                                boost::shared_ptr<DataView>& out)
 {
   boost::chrono::system_clock::time_point now =
-    boost::chrono::system_clock::now ();
+    m_scheduler.Now ();
 
-  cache_type::iterator it;
-  for (it = m_queue.begin (); it != m_queue.end (); it++)
+  const ndn::Name& name = i->GetName ();
+  bool mustBeFresh = i->GetMustBeFresh ();
+  // For now, ignore other selectors
+
+  CacheEntry* match = 0;
+  cache_type::iterator cit = m_cache.find (name);
+  if (cit != m_cache.end ()
+      && (!mustBeFresh || cit->second.expire > now))
+    match = &cit->second;
+  else
     {
-      bool mustBeFresh = i->getMustBeFresh ();
-      // For now, ignore other selectors
-      if (i->getName ().isPrefixOf (it->data->getName ())
-	  && (!mustBeFresh || (mustBeFresh && it->expire > now)))
-	{
-	  // Return the first match
-	  out = it->data;
-          return true;
-	}
+      // Take the first match in canonical order
+      index_type::iterator it;
+      for (it = m_index.lower_bound (name);
+           it != m_index.end () && name.isPrefixOf (it->first); it++)
+        {
+          if (!mustBeFresh || it->second->expire > now)
+            {
+              match = it->second;
+              break;
+            }
+        }
     }
 
-  return false;
+  if (match == 0)
+    return false;
+
+  m_policy->Hit (match);
+  if (match->data)
+    out = match->data;
+  else
+    out = boost::make_shared<DataView> (m_log->Read (match->offset));
+  return true;
 }
 
 void
-CacheManager::Insert (const boost::shared_ptr<ndn::Data>& d)
+CacheManager::Insert (const boost::shared_ptr<DataView>& received)
 {
-  boost::chrono::system_clock::time_point expire =
-    boost::chrono::system_clock::now () + d->getFreshnessPeriod ();
+  // Received data shares the receive buffer of the app face it came
+  // from. Cache a copy of its own, so as not to hold on to that buffer.
+  const ndn::Block& wire = received->GetWire ();
+  boost::shared_ptr<DataView> d (boost::make_shared<DataView> (ndn::Block (wire.wire (), wire.size ())));
 
-  //TODO: check for duplicate data already in cache
+  boost::chrono::system_clock::time_point expire =
+    m_scheduler.Now () + d->GetFreshnessPeriod ();
 
-  size_t sz = d->wireEncode ().size ();
-  if (sz > m_limit)
+  CacheEntry entry (d, expire);
+  if (entry.size > m_limit)
     {
       NDNEM_LOG_ERROR ("[CacheManager::Insert] (" << m_nodeId
-                       << ") data packet too big: " << d->getName ());
+                       << ") data packet too big: " << d->GetName ());
       return;
     }
 
-  // Cache replacement policy (FIFO)
-  while (m_count + sz > m_limit)
+  // Keep only the latest data with the same name
+  cache_type::iterator cit = m_cache.find (d->GetName ());
+  if (cit != m_cache.end ())
     {
-      size_t front_sz = m_queue.front ().size;
-      m_queue.pop_front ();
-      m_count -= front_sz;
-      assert (m_count >= 0);
+      CacheEntry& e = cit->second;
+      if (e.size == entry.size)
+        {
+          // Usually the same data forwarded again. Refresh it in place,
+          // keeping its position in the replacement policy.
+          if (e.data)
+            e.data = d;
+          else
+            m_log->Update (e.offset, d->GetWire (), GetLogTime (expire));
+          e.expire = expire;
+          this->AddExpiry (d->GetName (), expire);
+          return;
+        }
+
+      m_policy->Erase (&e);
+      this->Erase (&e);
     }
 
-  CacheEntry entry (d, expire);
-  m_queue.push_back (entry);
+  this->Add (entry);
+}
+
+void
+CacheManager::Add (CacheEntry& entry)
+{
+  // Make room according to the replacement policy
+  while (m_count + entry.size > m_limit)
+    {
+      CacheEntry* victim = m_policy->Evict (entry);
+      NDNEM_LOG_TRACE ("[CacheManager::Add] (" << m_nodeId
+                       << ") evict data: " << victim->name);
+      this->Erase (victim);
+    }
+
+  if (m_log && entry.data)
+    this->WriteToLog (entry);
+
+  CacheEntry* e = &m_cache.insert (std::make_pair (entry.name, entry)).first->second;
+  m_index.insert (std::make_pair (entry.name, e));
+  m_policy->Insert (e);
   m_count += entry.size;
+  this->AddExpiry (entry.name, entry.expire);
+}
+
+void
+CacheManager::AddExpiry (const ndn::Name& name, const boost::chrono::system_clock::time_point& expire)
+{
+  m_expiryQueue.push (std::make_pair (expire, name));
+
+  if (!m_isCleanUpScheduled || expire < m_nextCleanUp)
+    this->ScheduleCleanUp (expire);
+}
+
+void
+CacheManager::ScheduleCleanUp (const boost::chrono::system_clock::time_point& t)
+{
+  long delay = static_cast<long>
+    (boost::chrono::duration_cast<boost::chrono::microseconds> (t - m_scheduler.Now ()).count ());
+
+  m_isCleanUpScheduled = true;
+  m_nextCleanUp = t;
+  m_cleanupTimer.expires_from_now (boost::posix_time::microseconds (std::max (delay, 0L)));
+  m_cleanupTimer.async_wait (boost::bind (&CacheManager::CleanUp, this, _1));
+}
+
+void
+CacheManager::Erase (CacheEntry* e)
+{
+  if (!e->data)
+    m_log->Erase (e->offset);
+
+  assert (m_count >= e->size);
+  m_count -= e->size;
+  // The entry owns the name used to erase it
+  const ndn::Name name = e->name;
+  m_index.erase (name);
+  m_cache.erase (name);
+}
+
+void
+CacheManager::LoadLog ()
+{
+  std::vector<CacheLog::Record> records;
+  m_log->GetRecords (records);
+
+  boost::chrono::system_clock::time_point now =
+    m_scheduler.Now ();
+
+  std::vector<CacheLog::Record>::iterator it;
+  for (it = records.begin (); it != records.end (); it++)
+    {
+      boost::chrono::system_clock::time_point expire =
+        boost::chrono::system_clock::time_point (boost::chrono::microseconds (it->expire));
+      boost::shared_ptr<DataView> d (boost::make_shared<DataView> (m_log->Read (it->offset)));
+
+      // Drop stale data and data that no longer fit
+      CacheEntry entry (d, expire);
+      if (expire <= now || entry.size > m_limit
+          || m_cache.find (entry.name) != m_cache.end ())
+        {
+          m_log->Erase (it->offset);
+          continue;
+        }
+
+      entry.data.reset ();
+      entry.offset = it->offset;
+      this->Add (entry);
+    }
+
+  NDNEM_LOG_INFO ("[CacheManager::LoadLog] (" << m_nodeId << ") loaded "
+                  << m_cache.size () << " data packets");
+}
+
+void
+CacheManager::WriteToLog (CacheEntry& entry)
+{
+  const ndn::Block& wire = entry.data->GetWire ();
+  int64_t expire = GetLogTime (entry.expire);
+  if (!m_log->Append (wire, expire, entry.offset))
+    {
+      if (m_log->GetErasedSize () > 0)
+        this->CompactLog ();
+
+      if (!m_log->Append (wire, expire, entry.offset))
+        {
+          // Keep the data on the heap
+          NDNEM_LOG_INFO ("[CacheManager::WriteToLog] (" << m_nodeId
+                          << ") cache log is full");
+          return;
+        }
+    }
+
+  entry.data.reset ();
+}
+
+void
+CacheManager::CompactLog ()
+{
+  // Entries in the log, in the order of their records
+  std::map<std::size_t, CacheEntry*> entries;
+  cache_type::iterator it;
+  for (it = m_cache.begin (); it != m_cache.end (); it++)
+    {
+      if (!it->second.data)
+        entries[it->second.offset] = &it->second;
+    }
+
+  std::vector<std::pair<std::size_t, std::size_t> > moves;
+  m_log->Compact (moves);
+
+  std::vector<std::pair<std::size_t, std::size_t> >::iterator mit;
+  for (mit = moves.begin (); mit != moves.end (); mit++)
+    {
+      entries[mit->first]->offset = mit->second;
+    }
 }
 
 void
 CacheManager::CleanUp (const boost::system::error_code& error)
 {
+  if (error == boost::asio::error::operation_aborted)
+    return;  // rescheduled for an earlier expiry
+
   if (error)
     {
       NDNEM_LOG_ERROR ("[CacheManager::CleanUp] error = " << error.message ());
       return;
     }
 
+  m_isCleanUpScheduled = false;
+
   boost::chrono::system_clock::time_point now =
-    boost::chrono::system_clock::now ();
+    m_scheduler.Now ();
 
-  cache_type::iterator it = m_queue.begin ();
-  while (it != m_queue.end ())
+  while (!m_expiryQueue.empty () && m_expiryQueue.top ().first <= now)
     {
-      if (it->expire < now)
-        {
-          NDNEM_LOG_TRACE ("[CacheManager::CleanUp] (" << m_nodeId
-                           << ") remove data: " << it->data->getName ());
-          size_t sz = it->size;
-          it = m_queue.erase (it);
-          m_count -= sz;
-        }
-      else
-	it++;
+      cache_type::iterator it = m_cache.find (m_expiryQueue.top ().second);
+      m_expiryQueue.pop ();
+      // Skip data evicted or refreshed in the meantime
+      if (it == m_cache.end () || it->second.expire > now)
+        continue;
+
+      NDNEM_LOG_TRACE ("[CacheManager::CleanUp] (" << m_nodeId
+                       << ") remove data: " << it->first);
+      m_policy->Erase (&it->second);
+      this->Erase (&it->second);
     }
 
   // Schedule the next cleanup
-  ScheduleCleanUp ();
+  if (!m_expiryQueue.empty ())
+    this->ScheduleCleanUp (m_expiryQueue.top ().first);
 }
 
 } // namespace node
@@ -7,76 +7,136 @@
 #include <boost/bind.hpp>
 #include <boost/chrono/system_clocks.hpp>
 #include <boost/shared_ptr.hpp>
-#include <ndn-cxx/interest.hpp>
-#include <ndn-cxx/data.hpp>
+#include <boost/unordered_map.hpp>
 #include <iostream>
-#include <deque>
+#include <map>
+#include <queue>
+#include <vector>
 
 #include "logging.h"
+#include "cache-log.h"
+#include "cache-policy.h"
+#include "ndn-name-hash.h"
+#include "packet-view.h"
+#include "scheduler.h"
 
 namespace emulator {
 namespace node {
 
 class CacheEntry {
 public:
-  CacheEntry (const boost::shared_ptr<ndn::Data>& d,
+  CacheEntry (const boost::shared_ptr<DataView>& d,
 	      boost::chrono::system_clock::time_point& e)
-    : data (d)
+    : name (d->GetName ())
+    , data (d)
     , expire (e)
+    , offset (0)
   {
-    size = d->wireEncode ().size ();
+    size = d->GetWire ().size ();
   }
 
-  boost::shared_ptr<ndn::Data> data;
-  size_t size;
+  ndn::Name name;
+  boost::shared_ptr<DataView> data;  // null if the data is in the cache log
+  std::size_t size;
   boost::chrono::system_clock::time_point expire;
+  std::size_t offset;  // of the record in the cache log
 };
 
 class CacheManager {
 public:
-  static const boost::posix_time::time_duration CACHE_PURGE_INTERVAL;
-
-  CacheManager (const std::string& nodeId, int limit,
-		boost::asio::io_service& ioService)
-    : m_nodeId (nodeId)
-    , m_count (0)
-    , m_limit (limit)
-    , m_cleanupTimer (ioService)
-  {
-  }
+  // Data are kept in the cache log at logPath if given, or on the heap.
+  // The limit is in bytes.
+  CacheManager (const std::string& nodeId, std::size_t limit, const std::string& policy,
+                const std::string& logPath,
+		Scheduler& scheduler, boost::asio::io_service::strand& strand);
 
-  int
+  std::size_t
   GetLimit () const
   {
     return m_limit;
   }
 
-  typedef std::deque<CacheEntry> cache_type;
+  const std::string&
+  GetPolicyName () const
+  {
+    return m_policy->GetName ();
+  }
 
   bool
-  FindMatchingData (const boost::shared_ptr<ndn::Interest>&,
-		    boost::shared_ptr<ndn::Data>&);
+  IsPersistent () const
+  {
+    return static_cast<bool> (m_log);
+  }
 
-  void
-  Insert (const boost::shared_ptr<ndn::Data>&);
+  typedef boost::unordered_map<ndn::Name, CacheEntry, ndn_name_hash> cache_type;
+  typedef std::map<ndn::Name, CacheEntry*> index_type;
+
+  bool
+  FindMatchingData (const boost::shared_ptr<InterestView>&,
+		    boost::shared_ptr<DataView>&);
 
   void
-  ScheduleCleanUp ()
-  {
-    m_cleanupTimer.expires_from_now (CACHE_PURGE_INTERVAL);
-    m_cleanupTimer.async_wait (boost::bind (&CacheManager::CleanUp, this, _1));
-  }
+  Insert (const boost::shared_ptr<DataView>&);
 
 private:
+  // Time when the data with the given name becomes stale
+  typedef std::pair<boost::chrono::system_clock::time_point, ndn::Name> expiry_type;
+
+  struct ExpiryCompare {
+    bool
+    operator() (const expiry_type& a, const expiry_type& b) const
+    {
+      return a.first > b.first;  // earliest expiry on top
+    }
+  };
+
+  void
+  AddExpiry (const ndn::Name&, const boost::chrono::system_clock::time_point&);
+
+  void
+  ScheduleCleanUp (const boost::chrono::system_clock::time_point&);
+
   void
   CleanUp (const boost::system::error_code&);
 
+  // Evict entries to make room for the new one and add it
+  void
+  Add (CacheEntry&);
+
+  // Remove the entry without telling the replacement policy
+  void
+  Erase (CacheEntry*);
+
+  // Load the data left in the cache log by a previous run
+  void
+  LoadLog ();
+
+  // Move the data of the entry from the heap into the cache log
+  void
+  WriteToLog (CacheEntry&);
+
+  void
+  CompactLog ();
+
 private:
   const std::string& m_nodeId;
-  std::deque<CacheEntry> m_queue; // FIFO queue
-  int m_count;
-  const int m_limit;  // cache limit in # of bytes
-  boost::asio::deadline_timer m_cleanupTimer;
+  Scheduler& m_scheduler;
+  // Entries by exact name, the fast path for
+  // Interests carrying the full data name
+  cache_type m_cache;
+  // Data names in canonical order, so that all data under
+  // an Interest name are found next to each other
+  index_type m_index;
+  boost::shared_ptr<CachePolicy> m_policy;
+  boost::shared_ptr<CacheLog> m_log;
+  std::size_t m_count;
+  const std::size_t m_limit;  // cache limit in # of bytes
+  // Min-heap of entry expiries. Items of entries that have been evicted
+  // or refreshed in the meantime are skipped when they reach the top.
+  std::priority_queue<expiry_type, std::vector<expiry_type>, ExpiryCompare> m_expiryQueue;
+  Timer m_cleanupTimer;  // fires at the earliest expiry
+  bool m_isCleanUpScheduled;
+  boost::chrono::system_clock::time_point m_nextCleanUp;
 };
 
 } // namespace node
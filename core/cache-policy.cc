@@ -0,0 +1,270 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/assert.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cache-manager.h"
+#include "cache-policy.h"
+
+namespace emulator {
+namespace node {
+
+boost::shared_ptr<CachePolicy>
+CachePolicy::Create (const std::string& name, std::size_t limit)
+{
+  if (name == "fifo")
+    return boost::make_shared<QueuePolicy> (name, false);
+  else if (name == "lru")
+    return boost::make_shared<QueuePolicy> (name, true);
+  else if (name == "lfu")
+    return boost::make_shared<LfuPolicy> ();
+  else if (name == "arc")
+    return boost::make_shared<ArcPolicy> (limit);
+  else if (name == "random")
+    return boost::make_shared<RandomPolicy> ();
+  else
+    throw std::invalid_argument ("[CachePolicy::Create] unknown cache policy " + name);
+}
+
+void
+QueuePolicy::Insert (CacheEntry* e)
+{
+  m_position[e] = m_queue.insert (m_queue.end (), e);
+}
+
+void
+QueuePolicy::Hit (CacheEntry* e)
+{
+  if (m_update)
+    m_queue.splice (m_queue.end (), m_queue, m_position[e]);
+}
+
+void
+QueuePolicy::Erase (CacheEntry* e)
+{
+  boost::unordered_map<CacheEntry*, queue_type::iterator>::iterator it = m_position.find (e);
+  if (it == m_position.end ())
+    return;
+
+  m_queue.erase (it->second);
+  m_position.erase (it);
+}
+
+CacheEntry*
+QueuePolicy::Evict (const CacheEntry&)
+{
+  BOOST_ASSERT (!m_queue.empty ());
+  CacheEntry* victim = m_queue.front ();
+  m_queue.pop_front ();
+  m_position.erase (victim);
+  return victim;
+}
+
+void
+LfuPolicy::Insert (CacheEntry* e)
+{
+  if (m_buckets.empty () || m_buckets.front ().count != 1)
+    {
+      m_buckets.push_front (Bucket ());
+      m_buckets.front ().count = 1;
+    }
+
+  Position pos;
+  pos.bucket = m_buckets.begin ();
+  pos.entry = pos.bucket->entries.insert (pos.bucket->entries.end (), e);
+  m_position[e] = pos;
+}
+
+void
+LfuPolicy::Hit (CacheEntry* e)
+{
+  Position& pos = m_position[e];
+  bucket_list::iterator current = pos.bucket;
+  bucket_list::iterator next = current;
+  next++;
+  if (next == m_buckets.end () || next->count != current->count + 1)
+    {
+      next = m_buckets.insert (next, Bucket ());
+      next->count = current->count + 1;
+    }
+
+  next->entries.splice (next->entries.end (), current->entries, pos.entry);
+  pos.bucket = next;
+  if (current->entries.empty ())
+    m_buckets.erase (current);
+}
+
+void
+LfuPolicy::Remove (boost::unordered_map<CacheEntry*, Position>::iterator it)
+{
+  bucket_list::iterator bucket = it->second.bucket;
+  bucket->entries.erase (it->second.entry);
+  if (bucket->entries.empty ())
+    m_buckets.erase (bucket);
+  m_position.erase (it);
+}
+
+void
+LfuPolicy::Erase (CacheEntry* e)
+{
+  boost::unordered_map<CacheEntry*, Position>::iterator it = m_position.find (e);
+  if (it != m_position.end ())
+    this->Remove (it);
+}
+
+CacheEntry*
+LfuPolicy::Evict (const CacheEntry&)
+{
+  BOOST_ASSERT (!m_buckets.empty ());
+  CacheEntry* victim = m_buckets.front ().entries.front ();
+  this->Remove (m_position.find (victim));
+  return victim;
+}
+
+void
+ArcPolicy::Insert (CacheEntry* e)
+{
+  ListId list = T1;
+  boost::unordered_map<ndn::Name, GhostPosition, ndn_name_hash>::iterator git =
+    m_ghostPosition.find (e->name);
+  if (git != m_ghostPosition.end ())
+    {
+      // Recently evicted: grow the side of the cache it was evicted from
+      if (git->second.list == B1)
+        {
+          std::size_t delta = e->size * std::max<std::size_t> (1, m_size[B2] / m_size[B1]);
+          m_target = std::min (m_limit, m_target + delta);
+        }
+      else
+        {
+          std::size_t delta = e->size * std::max<std::size_t> (1, m_size[B1] / m_size[B2]);
+          m_target = delta > m_target ? 0 : m_target - delta;
+        }
+
+      m_size[git->second.list] -= git->second.it->size;
+      m_ghosts[git->second.list - B1].erase (git->second.it);
+      m_ghostPosition.erase (git);
+      list = T2;
+    }
+  else
+    {
+      // Keep T1 + B1 within the cache size and all lists within twice the size
+      while (m_size[B1] > 0 && m_size[T1] + m_size[B1] + e->size > m_limit)
+        this->EraseGhost (B1);
+      while (m_size[B2] > 0
+             && m_size[T1] + m_size[T2] + m_size[B1] + m_size[B2] + e->size > 2 * m_limit)
+        this->EraseGhost (B2);
+    }
+
+  Position pos;
+  pos.list = list;
+  pos.it = m_entries[list].insert (m_entries[list].end (), e);
+  m_position[e] = pos;
+  m_size[list] += e->size;
+}
+
+void
+ArcPolicy::Hit (CacheEntry* e)
+{
+  Position& pos = m_position[e];
+  m_entries[T2].splice (m_entries[T2].end (), m_entries[pos.list], pos.it);
+  m_size[pos.list] -= e->size;
+  m_size[T2] += e->size;
+  pos.list = T2;
+}
+
+void
+ArcPolicy::Erase (CacheEntry* e)
+{
+  boost::unordered_map<CacheEntry*, Position>::iterator it = m_position.find (e);
+  if (it == m_position.end ())
+    return;
+
+  m_entries[it->second.list].erase (it->second.it);
+  m_size[it->second.list] -= e->size;
+  m_position.erase (it);
+}
+
+CacheEntry*
+ArcPolicy::Evict (const CacheEntry& incoming)
+{
+  boost::unordered_map<ndn::Name, GhostPosition, ndn_name_hash>::iterator git =
+    m_ghostPosition.find (incoming.name);
+  bool inB2 = git != m_ghostPosition.end () && git->second.list == B2;
+
+  ListId list = T2;
+  if (m_entries[T2].empty ()
+      || (!m_entries[T1].empty ()
+          && (m_size[T1] > m_target || (inB2 && m_size[T1] == m_target))))
+    list = T1;
+
+  BOOST_ASSERT (!m_entries[list].empty ());
+  CacheEntry* victim = m_entries[list].front ();
+  this->MoveToGhost (list, list == T1 ? B1 : B2);
+  return victim;
+}
+
+void
+ArcPolicy::MoveToGhost (ListId from, ListId to)
+{
+  CacheEntry* e = m_entries[from].front ();
+  m_entries[from].pop_front ();
+  m_size[from] -= e->size;
+  m_position.erase (e);
+
+  Ghost ghost;
+  ghost.name = e->name;
+  ghost.size = e->size;
+  GhostPosition pos;
+  pos.list = to;
+  pos.it = m_ghosts[to - B1].insert (m_ghosts[to - B1].end (), ghost);
+  m_ghostPosition[ghost.name] = pos;
+  m_size[to] += ghost.size;
+}
+
+void
+ArcPolicy::EraseGhost (ListId list)
+{
+  Ghost& ghost = m_ghosts[list - B1].front ();
+  m_size[list] -= ghost.size;
+  m_ghostPosition.erase (ghost.name);
+  m_ghosts[list - B1].pop_front ();
+}
+
+void
+RandomPolicy::Insert (CacheEntry* e)
+{
+  m_index[e] = m_entries.size ();
+  m_entries.push_back (e);
+}
+
+void
+RandomPolicy::Erase (CacheEntry* e)
+{
+  boost::unordered_map<CacheEntry*, std::size_t>::iterator it = m_index.find (e);
+  if (it == m_index.end ())
+    return;
+
+  // Move the last entry into the hole
+  CacheEntry* last = m_entries.back ();
+  m_entries[it->second] = last;
+  m_index[last] = it->second;
+  m_entries.pop_back ();
+  m_index.erase (e);
+}
+
+CacheEntry*
+RandomPolicy::Evict (const CacheEntry&)
+{
+  BOOST_ASSERT (!m_entries.empty ());
+  boost::random::uniform_int_distribution<std::size_t> dist (0, m_entries.size () - 1);
+  CacheEntry* victim = m_entries[dist (m_engine)];
+  this->Erase (victim);
+  return victim;
+}
+
+} // namespace node
+} // namespace emulator
@@ -0,0 +1,247 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __CACHE_POLICY_H__
+#define __CACHE_POLICY_H__
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+#include <ndn-cxx/name.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "ndn-name-hash.h"
+
+namespace emulator {
+namespace node {
+
+class CacheEntry;
+
+/*
+ * Replacement policy of the content store. The cache manager tells the
+ * policy about every entry that enters or leaves the cache and about every
+ * cache hit, and asks it for victims when the cache is full. All operations
+ * take constant (expected) time.
+ */
+class CachePolicy : boost::noncopyable {
+public:
+  // Create the policy with the given name: fifo, lru, lfu, arc or random
+  static boost::shared_ptr<CachePolicy>
+  Create (const std::string& name, std::size_t limit);
+
+  virtual
+  ~CachePolicy ()
+  {
+  }
+
+  const std::string&
+  GetName () const
+  {
+    return m_name;
+  }
+
+  virtual void
+  Insert (CacheEntry*) = 0;
+
+  virtual void
+  Hit (CacheEntry*) = 0;
+
+  // Forget an entry removed from the cache for other reasons
+  virtual void
+  Erase (CacheEntry*) = 0;
+
+  // Choose the entry to evict in order to make room for the incoming
+  // one and forget about it. The cache must not be empty.
+  virtual CacheEntry*
+  Evict (const CacheEntry& incoming) = 0;
+
+protected:
+  explicit
+  CachePolicy (const std::string& name)
+    : m_name (name)
+  {
+  }
+
+private:
+  const std::string m_name;
+};
+
+/*
+ * Evicts entries in insertion order. With update set, hits move entries
+ * to the back of the queue, which makes it LRU.
+ */
+class QueuePolicy : public CachePolicy {
+public:
+  QueuePolicy (const std::string& name, bool update)
+    : CachePolicy (name)
+    , m_update (update)
+  {
+  }
+
+  virtual void
+  Insert (CacheEntry*);
+
+  virtual void
+  Hit (CacheEntry*);
+
+  virtual void
+  Erase (CacheEntry*);
+
+  virtual CacheEntry*
+  Evict (const CacheEntry&);
+
+private:
+  typedef std::list<CacheEntry*> queue_type;
+
+  const bool m_update;
+  queue_type m_queue;  // victims at the front
+  boost::unordered_map<CacheEntry*, queue_type::iterator> m_position;
+};
+
+/*
+ * Evicts the least frequently used entry, the oldest one among entries
+ * with the same count. Entries are kept in buckets of equal hit count,
+ * so that a hit moves an entry to the next bucket in constant time.
+ */
+class LfuPolicy : public CachePolicy {
+public:
+  LfuPolicy ()
+    : CachePolicy ("lfu")
+  {
+  }
+
+  virtual void
+  Insert (CacheEntry*);
+
+  virtual void
+  Hit (CacheEntry*);
+
+  virtual void
+  Erase (CacheEntry*);
+
+  virtual CacheEntry*
+  Evict (const CacheEntry&);
+
+private:
+  struct Bucket {
+    std::size_t count;
+    std::list<CacheEntry*> entries;  // oldest first
+  };
+
+  typedef std::list<Bucket> bucket_list;
+
+  struct Position {
+    bucket_list::iterator bucket;
+    std::list<CacheEntry*>::iterator entry;
+  };
+
+  void
+  Remove (boost::unordered_map<CacheEntry*, Position>::iterator);
+
+private:
+  bucket_list m_buckets;  // in increasing order of count
+  boost::unordered_map<CacheEntry*, Position> m_position;
+};
+
+/*
+ * Adaptive Replacement Cache (Megiddo and Modha, FAST 2003), with sizes
+ * counted in bytes. T1 holds entries seen once recently and T2 entries hit
+ * at least twice. The ghost lists B1 and B2 remember the names of entries
+ * evicted from T1 and T2, and hits on them adapt the target size of T1.
+ */
+class ArcPolicy : public CachePolicy {
+public:
+  explicit
+  ArcPolicy (std::size_t limit)
+    : CachePolicy ("arc")
+    , m_limit (limit)
+    , m_target (0)
+  {
+    m_size[T1] = m_size[T2] = m_size[B1] = m_size[B2] = 0;
+  }
+
+  virtual void
+  Insert (CacheEntry*);
+
+  virtual void
+  Hit (CacheEntry*);
+
+  virtual void
+  Erase (CacheEntry*);
+
+  virtual CacheEntry*
+  Evict (const CacheEntry&);
+
+private:
+  enum ListId { T1 = 0, T2, B1, B2 };
+
+  struct Ghost {
+    ndn::Name name;
+    std::size_t size;
+  };
+
+  typedef std::list<CacheEntry*> entry_list;
+  typedef std::list<Ghost> ghost_list;
+
+  struct Position {
+    ListId list;
+    entry_list::iterator it;
+  };
+
+  struct GhostPosition {
+    ListId list;
+    ghost_list::iterator it;
+  };
+
+  void
+  MoveToGhost (ListId, ListId);
+
+  void
+  EraseGhost (ListId);
+
+private:
+  const std::size_t m_limit;  // in bytes
+  std::size_t m_target;  // adaptive target size of T1 in bytes
+  std::size_t m_size[4];  // size of each list in bytes
+  entry_list m_entries[2];  // T1 and T2, LRU at the front
+  ghost_list m_ghosts[2];  // B1 and B2, LRU at the front
+  boost::unordered_map<CacheEntry*, Position> m_position;
+  boost::unordered_map<ndn::Name, GhostPosition, ndn_name_hash> m_ghostPosition;
+};
+
+/*
+ * Evicts an entry chosen uniformly at random.
+ */
+class RandomPolicy : public CachePolicy {
+public:
+  RandomPolicy ()
+    : CachePolicy ("random")
+  {
+  }
+
+  virtual void
+  Insert (CacheEntry*);
+
+  virtual void
+  Hit (CacheEntry*)
+  {
+  }
+
+  virtual void
+  Erase (CacheEntry*);
+
+  virtual CacheEntry*
+  Evict (const CacheEntry&);
+
+private:
+  boost::random::mt19937 m_engine;
+  std::vector<CacheEntry*> m_entries;
+  boost::unordered_map<CacheEntry*, std::size_t> m_index;  // position in m_entries
+};
+
+} // namespace node
+} // namespace emulator
+
+#endif // __CACHE_POLICY_H__
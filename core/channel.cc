@@ -0,0 +1,111 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <cmath>
+#include <stdexcept>
+
+#include "channel.h"
+
+namespace emulator {
+
+const double Channel::DEFAULT_CAPTURE_THRESHOLD = 3.0;
+
+Channel::Channel ()
+  : m_detectionTime (0)
+{
+  this->SetCaptureThreshold (DEFAULT_CAPTURE_THRESHOLD);
+}
+
+void
+Channel::Resize (std::size_t n, long detectionTime)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  m_signals.assign (n, std::vector<Signal> ());
+  m_detectionTime = boost::chrono::microseconds (detectionTime);
+}
+
+void
+Channel::SetCaptureThreshold (double db)
+{
+  if (db < 0.0)
+    throw std::invalid_argument ("[Channel::SetCaptureThreshold] negative threshold");
+
+  m_captureThreshold = db;
+  m_captureRatio = std::pow (10.0, db / 10.0);
+}
+
+void
+Channel::AddSignal (int receiver, int sender, const time_point& start, long airtime,
+                    double power)
+{
+  Signal s;
+  s.start = start;
+  s.end = start + boost::chrono::microseconds (airtime);
+  s.sender = sender;
+  s.power = power;
+
+  boost::mutex::scoped_lock lock (m_mutex);
+  m_signals[receiver].push_back (s);
+}
+
+bool
+Channel::IsBusy (int receiver, const time_point& now)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  std::vector<Signal>& signals = m_signals[receiver];
+  this->Prune (signals, now);
+
+  for (std::size_t i = 0; i < signals.size (); i++)
+    {
+      if (signals[i].start + m_detectionTime <= now && now < signals[i].end)
+        return true;
+    }
+  return false;
+}
+
+bool
+Channel::IsCaptured (int receiver, int sender, const time_point& start, long airtime,
+                     double power, const time_point& now)
+{
+  const time_point end = start + boost::chrono::microseconds (airtime);
+
+  boost::mutex::scoped_lock lock (m_mutex);
+  std::vector<Signal>& signals = m_signals[receiver];
+
+  double interference = 0.0;
+  for (std::size_t i = 0; i < signals.size (); i++)
+    {
+      const Signal& s = signals[i];
+      if (s.sender == sender && s.start == start)
+        continue;  // the frame itself
+      if (s.start < end && start < s.end && s.start + m_detectionTime <= end)
+        interference += s.power;
+    }
+
+  this->Prune (signals, now);
+  return power >= interference * m_captureRatio;
+}
+
+void
+Channel::Prune (std::vector<Signal>& signals, const time_point& now)
+{
+  // Earliest start of the frames not over yet, including those ending
+  // now, whose receivers may not have decided on them yet
+  time_point minStart = time_point::max ();
+  for (std::size_t i = 0; i < signals.size (); i++)
+    {
+      if (signals[i].end >= now && signals[i].start < minStart)
+        minStart = signals[i].start;
+    }
+
+  // A frame overlapping a finished one may still be added up to the
+  // detection time after its end
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < signals.size (); i++)
+    {
+      if (signals[i].end + m_detectionTime > now || signals[i].end > minStart)
+        signals[n++] = signals[i];
+    }
+  signals.resize (n);
+}
+
+} // namespace emulator
@@ -0,0 +1,99 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <vector>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+namespace emulator {
+
+/*
+ * Shared state of the medium of a link. The frames on the air at each
+ * receiver are kept as time intervals, from which the devices derive
+ * carrier sense, collisions and capture, instead of from their own PHY
+ * state alone.
+ *
+ * A frame only counts once the receiver has had the detection time of the
+ * PHY to notice it. The sender adds the intervals of a frame as soon as it
+ * is sent (see Link::Transmit), so a device senses the frames of its
+ * neighbors even before its strand has handled them. Frames from another
+ * partition are added when they are detected, which gives the same result.
+ *
+ * A frame is received if its power exceeds the sum of the powers of the
+ * frames overlapping it by the capture threshold.
+ */
+class Channel : boost::noncopyable {
+public:
+  typedef boost::chrono::system_clock::time_point time_point;
+
+  static const double DEFAULT_CAPTURE_THRESHOLD;  // in dB
+
+  Channel ();
+
+  // Number of devices on the link, and detection time in us
+  void
+  Resize (std::size_t n, long detectionTime);
+
+  void
+  SetCaptureThreshold (double db);
+
+  double
+  GetCaptureThreshold () const
+  {
+    return m_captureThreshold;
+  }
+
+  // Power ratio between a frame and the frame it takes the receiver
+  // over from, or the sum of the frames overlapping it
+  double
+  GetCaptureRatio () const
+  {
+    return m_captureRatio;
+  }
+
+  // Frame of the sender heard by the receiver from start on for airtime
+  // us, with the given power in mW
+  void
+  AddSignal (int receiver, int sender, const time_point& start, long airtime, double power);
+
+  // Whether any frame detected by the receiver is on the air
+  bool
+  IsBusy (int receiver, const time_point& now);
+
+  // Whether the frame of the sender that started at the given time
+  // survives the frames overlapping it and detected before its end.
+  // To be called at the end of the frame.
+  bool
+  IsCaptured (int receiver, int sender, const time_point& start, long airtime,
+              double power, const time_point& now);
+
+private:
+  struct Signal {
+    time_point start;
+    time_point end;
+    int sender;
+    double power;  // in mW
+  };
+
+  // Forget the frames that no frame still on the air or to come
+  // overlaps, and that all receivers have detected. Expects the mutex
+  // to be held.
+  void
+  Prune (std::vector<Signal>& signals, const time_point& now);
+
+private:
+  double m_captureThreshold;  // in dB
+  double m_captureRatio;
+  boost::chrono::microseconds m_detectionTime;
+
+  // Frames by receiver index, shared by the strands of all devices
+  boost::mutex m_mutex;
+  std::vector<std::vector<Signal> > m_signals;
+};
+
+} // namespace emulator
+
+#endif // __CHANNEL_H__
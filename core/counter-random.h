@@ -0,0 +1,97 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __COUNTER_RANDOM_H__
+#define __COUNTER_RANDOM_H__
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+namespace emulator {
+
+/*
+ * Counter-based random number generator: the i-th number of a stream is
+ * the splitmix64 finalizer applied to key + i * golden ratio. The state
+ * is only the key and a counter, and the numbers of a batch do not depend
+ * on each other, so drawing a batch is a loop the compiler can unroll and
+ * vectorize. Streams with different keys are independent for our purposes.
+ */
+class CounterRandom {
+public:
+  explicit
+  CounterRandom (uint64_t key = 0)
+    : m_key (key)
+    , m_counter (0)
+  {
+  }
+
+  static uint64_t
+  Mix (uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  // Key from a name: the 64-bit FNV-1a hash, which unlike boost::hash
+  // is the same on every platform and boost version
+  static uint64_t
+  Hash (const std::string& name)
+  {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < name.size (); i++)
+      {
+        h ^= static_cast<unsigned char> (name[i]);
+        h *= 0x100000001b3ULL;
+      }
+    return h;
+  }
+
+  // Probability as a threshold for the numbers, see Sample
+  static uint64_t
+  GetThreshold (double p)
+  {
+    if (p <= 0.0)
+      return 0;
+    if (p >= 1.0)
+      return ~static_cast<uint64_t> (0);
+    return static_cast<uint64_t> (p * 18446744073709551616.0);  // 2^64
+  }
+
+  uint64_t
+  operator() ()
+  {
+    return Mix (m_key + ++m_counter * GOLDEN);
+  }
+
+  // Uniform in [0, 1)
+  double
+  Uniform ()
+  {
+    return ((*this) () >> 11) * (1.0 / 9007199254740992.0);  // 2^-53
+  }
+
+  // One Bernoulli trial per threshold: hits[i] is 1 with
+  // probability thresholds[i] / 2^64
+  void
+  Sample (const uint64_t* thresholds, uint8_t* hits, std::size_t n)
+  {
+    const uint64_t base = m_key + m_counter * GOLDEN;
+    for (std::size_t i = 0; i < n; i++)
+      {
+        hits[i] = Mix (base + (i + 1) * GOLDEN) < thresholds[i];
+      }
+    m_counter += n;
+  }
+
+private:
+  static const uint64_t GOLDEN = 0x9e3779b97f4a7c15ULL;
+
+private:
+  uint64_t m_key;
+  uint64_t m_counter;
+};
+
+} // namespace emulator
+
+#endif // __COUNTER_RANDOM_H__
@@ -0,0 +1,114 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+
+#include "logging.h"
+#include "dead-nonce-list.h"
+#include "ndn-name-hash.h"
+
+namespace emulator {
+namespace node {
+
+const std::size_t DeadNonceList::FILTER_SIZE = 1 << 15;  // 4 KB per filter
+const int DeadNonceList::N_HASHES = 4;
+const boost::posix_time::time_duration DeadNonceList::LIFETIME =
+  boost::posix_time::seconds (6);
+
+DeadNonceList::DeadNonceList (Scheduler& scheduler, boost::asio::io_service::strand& strand)
+  : m_current (FILTER_SIZE / 64, 0)
+  , m_previous (FILTER_SIZE / 64, 0)
+  , m_nCurrent (0)
+  , m_nPrevious (0)
+  , m_rotateTimer (scheduler, strand)
+  , m_isRotateScheduled (false)
+{
+}
+
+uint64_t
+DeadNonceList::Hash (const ndn::Name& name, const uint32_t nonce)
+{
+  std::size_t seed = ndn_name_hash () (name);
+  boost::hash_combine (seed, nonce);
+  return seed;
+}
+
+uint64_t
+DeadNonceList::GetBit (uint64_t h, int i)
+{
+  // Double hashing: the second hash is the first one with its halves
+  // swapped, made odd so that it cycles through all bit positions
+  uint64_t h2 = ((h >> 32) | (h << 32)) | 1;
+  return (h + i * h2) & (FILTER_SIZE - 1);
+}
+
+bool
+DeadNonceList::Test (const std::vector<uint64_t>& filter, uint64_t h)
+{
+  for (int i = 0; i < N_HASHES; i++)
+    {
+      uint64_t bit = GetBit (h, i);
+      if ((filter[bit >> 6] & (1ULL << (bit & 63))) == 0)
+        return false;
+    }
+  return true;
+}
+
+void
+DeadNonceList::Add (const ndn::Name& name, const uint32_t nonce)
+{
+  uint64_t h = Hash (name, nonce);
+  for (int i = 0; i < N_HASHES; i++)
+    {
+      uint64_t bit = GetBit (h, i);
+      m_current[bit >> 6] |= (1ULL << (bit & 63));
+    }
+  m_nCurrent++;
+
+  // The rotation timer only runs while the list is not empty, so that
+  // an idle node does not keep the virtual clock busy
+  if (!m_isRotateScheduled)
+    {
+      m_isRotateScheduled = true;
+      m_rotateTimer.expires_from_now (LIFETIME);
+      m_rotateTimer.async_wait (boost::bind (&DeadNonceList::Rotate, this, _1));
+    }
+}
+
+bool
+DeadNonceList::Has (const ndn::Name& name, const uint32_t nonce) const
+{
+  if (m_nCurrent == 0 && m_nPrevious == 0)
+    return false;
+
+  uint64_t h = Hash (name, nonce);
+  return (m_nCurrent > 0 && Test (m_current, h))
+    || (m_nPrevious > 0 && Test (m_previous, h));
+}
+
+void
+DeadNonceList::Rotate (const boost::system::error_code& error)
+{
+  if (error)
+    {
+      NDNEM_LOG_ERROR ("[DeadNonceList::Rotate] error = " << error.message ());
+      return;
+    }
+
+  m_previous.swap (m_current);
+  m_nPrevious = m_nCurrent;
+  std::fill (m_current.begin (), m_current.end (), 0);
+  m_nCurrent = 0;
+
+  if (m_nPrevious > 0)
+    {
+      m_rotateTimer.expires_from_now (LIFETIME);
+      m_rotateTimer.async_wait (boost::bind (&DeadNonceList::Rotate, this, _1));
+    }
+  else
+    m_isRotateScheduled = false;
+}
+
+} // namespace node
+} // namespace emulator
@@ -0,0 +1,67 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __DEAD_NONCE_LIST_H__
+#define __DEAD_NONCE_LIST_H__
+
+#include <boost/asio.hpp>
+#include <boost/utility.hpp>
+#include <ndn-cxx/name.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace emulator {
+namespace node {
+
+/*
+ * Remembers the (name, nonce) pairs of Interests whose PIT entries have
+ * been satisfied or have expired, so that looping Interests can still be
+ * detected after the entry is gone.
+ *
+ * The list uses a fixed amount of memory: two Bloom filters of
+ * FILTER_SIZE bits each. New pairs go into the current filter, which
+ * becomes the previous one after LIFETIME, so a pair is remembered for
+ * one to two lifetimes. False positives cause a fresh Interest to be
+ * dropped as a loop and are rare for the expected load.
+ */
+class DeadNonceList : boost::noncopyable {
+public:
+  static const std::size_t FILTER_SIZE;  // in bits, power of two
+  static const int N_HASHES;
+  static const boost::posix_time::time_duration LIFETIME;
+
+  DeadNonceList (Scheduler& scheduler, boost::asio::io_service::strand& strand);
+
+  void
+  Add (const ndn::Name&, const uint32_t);
+
+  bool
+  Has (const ndn::Name&, const uint32_t) const;
+
+private:
+  static uint64_t
+  Hash (const ndn::Name&, const uint32_t);
+
+  static uint64_t
+  GetBit (uint64_t, int);
+
+  static bool
+  Test (const std::vector<uint64_t>&, uint64_t);
+
+  void
+  Rotate (const boost::system::error_code&);
+
+private:
+  std::vector<uint64_t> m_current;
+  std::vector<uint64_t> m_previous;
+  std::size_t m_nCurrent;  // # of pairs added to the current filter
+  std::size_t m_nPrevious;
+  Timer m_rotateTimer;
+  bool m_isRotateScheduled;
+};
+
+} // namespace node
+} // namespace emulator
+
+#endif // __DEAD_NONCE_LIST_H__
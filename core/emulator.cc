@@ -1,15 +1,48 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
+#include <algorithm>
 #include <exception>
+#include <limits>
+#include <set>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/assert.hpp>
 #include <boost/foreach.hpp>
 
 #include "emulator.h"
+#include "io-uring.h"
 
 namespace emulator {
 
+Emulator::Emulator (bool virtualTime, int nThreads, int nPartitions, bool ioUring)
+  : m_scheduler (m_ioService, virtualTime, nThreads)
+  , m_nPartitions (nPartitions)
+{
+  if (m_nPartitions < 1)
+    throw std::invalid_argument ("[Emulator::Emulator] need at least one partition");
+
+  if (m_nPartitions > 1)
+    {
+      if (!virtualTime)
+        throw std::invalid_argument ("[Emulator::Emulator] partitions require virtual-time mode");
+
+      m_parallelScheduler = boost::make_shared<ParallelScheduler> (m_nPartitions);
+    }
+
+  if (ioUring)
+    {
+#ifdef NDNEM_HAVE_IO_URING
+      for (int i = 0; i < m_nPartitions; i++)
+        {
+          m_ioUrings.push_back (boost::make_shared<IoUring>
+                                (boost::ref (this->GetPartitionScheduler (i).GetIoService ())));
+        }
+#else
+      throw std::invalid_argument ("[Emulator::Emulator] built without io_uring support");
+#endif
+    }
+}
+
 void
 Emulator::ReadNetworkConfig (const std::string& path)
 {
@@ -34,12 +67,19 @@ Emulator::ReadNetworkConfig (const std::string& path)
 
       std::map<std::string, boost::shared_ptr<Link> >::iterator it = m_linkTable.find (linkId);
       if (it == m_linkTable.end ())
-        m_linkTable[linkId] = boost::make_shared<Link> (linkId, *txRate, *mtu);
+        {
+          boost::shared_ptr<Link> l = boost::make_shared<Link> (linkId, *txRate, *mtu);
+          l->GetChannel ().SetCaptureThreshold
+            (link.get<double> ("CaptureThreshold", Channel::DEFAULT_CAPTURE_THRESHOLD));
+          m_linkTable[linkId] = l;
+        }
       else
         throw std::runtime_error ("[Emulator::ReadNetworkConfig] duplicate link id " + linkId);
     }
 
   uint64_t globalMacAssigner = 0x0001; // ensures we allocate globally unique mac addresses
+  int nodeIndex = 0;
+  std::set<std::string> cacheLogs;  // a log can only back one node
   ptree& nodes = config.get_child ("Config.Nodes");
   // First iteration will create all the nodes & devices
   BOOST_FOREACH (ptree::value_type& v, nodes)
@@ -48,16 +88,39 @@ Emulator::ReadNetworkConfig (const std::string& path)
       ptree& node = v.second;
       const std::string nodeId = node.get<std::string> ("Id");
       const std::string path = node.get<std::string> ("Path");
-      boost::optional<int> cacheLimit = node.get_optional<int> ("CacheLimit");
-      if (!cacheLimit)
-        cacheLimit = boost::optional<int> (100);  // default cache size is 100 KB
+      const std::string shmPath = node.get<std::string> ("ShmPath", "");
+      // In KB, default is 100 KB. Twice the limit in bytes has to fit
+      // in memory for the cache log and the ARC policy.
+      const int64_t cacheLimit = node.get<int64_t> ("CacheLimit", 100);
+      if (cacheLimit < 0
+          || static_cast<uint64_t> (cacheLimit) > (std::numeric_limits<std::size_t>::max () >> 11))
+        throw std::runtime_error ("[Emulator::ReadNetworkConfig] invalid cache limit for node "
+                                  + nodeId);
+      const std::string cachePolicy = node.get<std::string> ("CachePolicy", "fifo");
+      const std::string cacheLog = node.get<std::string> ("CacheLog", "");
+      if (!cacheLog.empty () && !cacheLogs.insert (cacheLog).second)
+        throw std::runtime_error ("[Emulator::ReadNetworkConfig] cache log " + cacheLog
+                                  + " of node " + nodeId + " is used by another node");
+      const std::string cacheAdmission = node.get<std::string> ("CacheAdmission", "always");
+      const double cacheProbability = node.get<double> ("CacheProbability", 1.0);
+      boost::optional<int> partition = node.get_optional<int> ("Partition");
+      if (!partition)
+        partition = boost::optional<int> (nodeIndex % m_nPartitions);  // round robin by default
+      else if (*partition < 0 || *partition >= m_nPartitions)
+        throw std::runtime_error ("[Emulator::ReadNetworkConfig] invalid partition for node "
+                                  + nodeId);
+      nodeIndex++;
 
       std::map<std::string, boost::shared_ptr<Node> >::iterator it = m_nodeTable.find (nodeId);
       if (it == m_nodeTable.end ())
         {
           boost::shared_ptr<Node> pnode
-            (boost::make_shared<Node> (nodeId, path, (*cacheLimit << 10),
-                                       boost::ref (m_ioService)));
+            (boost::make_shared<Node> (nodeId, path, shmPath,
+                                       static_cast<std::size_t> (cacheLimit) << 10, cachePolicy,
+                                       cacheLog, cacheAdmission, cacheProbability,
+                                       boost::ref (this->GetPartitionScheduler (*partition))));
+          if (!m_ioUrings.empty ())
+            pnode->SetIoUring (m_ioUrings[*partition].get ());
 
           BOOST_FOREACH (ptree::value_type& v, node.get_child ("Devices"))
             {
@@ -137,11 +200,36 @@ Emulator::ReadNetworkConfig (const std::string& path)
               ptree& con = v.second;
               const std::string from = con.get<std::string> ("From");
               const std::string to = con.get<std::string> ("To");
-              const double rate = con.get<double> ("LossRate");
+              const std::string model = con.get<std::string> ("LossModel", "bernoulli");
 
-              // For now, only support packet loss rate
-              boost::shared_ptr<LinkAttribute> attr =
-                boost::make_shared<LinkAttribute> (rate);
+              boost::shared_ptr<LinkAttribute> attr;
+              if (model == "bernoulli")
+                attr = boost::make_shared<LinkAttribute> (con.get<double> ("LossRate"));
+              else if (model == "gilbert-elliott")
+                attr = boost::make_shared<LinkAttribute> (con.get<double> ("GoodToBad"),
+                                                          con.get<double> ("BadToGood"),
+                                                          con.get<double> ("LossRate", 0.0),
+                                                          con.get<double> ("BadLossRate", 1.0));
+              else if (model == "trace")
+                {
+                  boost::shared_ptr<LossTrace> trace =
+                    this->GetLossTrace (con.get<std::string> ("Trace"));
+                  attr = boost::make_shared<LinkAttribute> (trace,
+                                                            con.get<int64_t> ("TraceInterval", 1000));
+                }
+              else
+                throw std::runtime_error ("[Emulator::ReadNetworkConfig] unknown loss model "
+                                          + model + " from " + from + " to " + to);
+
+              const std::string jitter = con.get<std::string> ("JitterDistribution", "uniform");
+              if (jitter != "uniform" && jitter != "exponential")
+                throw std::runtime_error ("[Emulator::ReadNetworkConfig] unknown jitter distribution "
+                                          + jitter + " from " + from + " to " + to);
+              attr->SetDelay (con.get<long> ("Delay", 0), con.get<long> ("Jitter", 0),
+                              jitter == "uniform" ? LinkAttribute::UNIFORM
+                                                  : LinkAttribute::EXPONENTIAL);
+              attr->SetTxRate (con.get<double> ("TxRate", 0.0));
+              attr->SetRxPower (con.get<double> ("RxPower", 0.0));
 
               link->AddConnection (from, to, attr);
             }
@@ -149,9 +237,28 @@ Emulator::ReadNetworkConfig (const std::string& path)
       else
         throw std::runtime_error ("[Emulator::ReadNetworkConfig] unkown matrix link id " + linkId);
     }
+
+  std::map<std::string, boost::shared_ptr<Link> >::iterator lit;
+  for (lit = m_linkTable.begin (); lit != m_linkTable.end (); lit++)
+    {
+      lit->second->CompileLinkMatrix ();
+    }
   this->PrintLinks ();
 }
 
+boost::shared_ptr<LossTrace>
+Emulator::GetLossTrace (const std::string& path)
+{
+  // Connections replaying the same trace share the mapping
+  std::map<std::string, boost::shared_ptr<LossTrace> >::iterator it = m_lossTraces.find (path);
+  if (it != m_lossTraces.end ())
+    return it->second;
+
+  boost::shared_ptr<LossTrace> trace = boost::make_shared<LossTrace> (path);
+  m_lossTraces[path] = trace;
+  return trace;
+}
+
 void
 Emulator::PrintNodes ()
 {
@@ -183,7 +290,21 @@ Emulator::Start ()
       it->second->Start ();
     }
 
-  m_ioService.run (); // This call will block
+  if (m_parallelScheduler)
+    {
+      // The shortest time to detect a frame on any connection bounds
+      // how far the partitions can run ahead without hearing from each other
+      long lookahead = std::numeric_limits<long>::max ();
+      std::map<std::string, boost::shared_ptr<Link> >::iterator lit;
+      for (lit = m_linkTable.begin (); lit != m_linkTable.end (); lit++)
+        {
+          lookahead = std::min (lookahead, lit->second->GetLookahead ());
+        }
+      m_parallelScheduler->SetLookahead (lookahead);
+      m_parallelScheduler->Run (); // This call will block
+    }
+  else
+    m_scheduler.Run (); // This call will block
 }
 
 } // namespace emulator
@@ -4,16 +4,25 @@
 #define __EMULATOR_H__
 
 #include <map>
+#include <vector>
 
 #include "logging.h"
 #include "link-face.h"
 #include "link.h"
 #include "node.h"
+#include "parallel-scheduler.h"
+#include "scheduler.h"
 
 namespace emulator {
 
+class IoUring;
+
 class Emulator {
 public:
+  explicit
+  Emulator (bool virtualTime = false, int nThreads = 1, int nPartitions = 1,
+            bool ioUring = false);
+
   void
   ReadNetworkConfig (const std::string& path);
 
@@ -40,13 +49,38 @@ public:
   void
   Stop ()
   {
-    m_ioService.stop ();
+    if (m_parallelScheduler)
+      m_parallelScheduler->Stop ();
+    else
+      m_scheduler.Stop ();
+  }
+
+private:
+  // Loaded once per file
+  boost::shared_ptr<LossTrace>
+  GetLossTrace (const std::string& path);
+
+  // Scheduler driving the nodes of the given partition
+  Scheduler&
+  GetPartitionScheduler (int partition)
+  {
+    if (m_parallelScheduler)
+      return m_parallelScheduler->GetPartition (partition);
+    else
+      return m_scheduler;
   }
 
 private:
   boost::asio::io_service m_ioService;
+  Scheduler m_scheduler;
+  boost::shared_ptr<ParallelScheduler> m_parallelScheduler; // only for parallel virtual-time runs
+  int m_nPartitions;
+  // Per partition, only with io_uring. Declared before the nodes,
+  // which cancel their requests when destroyed.
+  std::vector<boost::shared_ptr<IoUring> > m_ioUrings;
   std::map<std::string, boost::shared_ptr<Node> > m_nodeTable; // all emulated nodes
   std::map<std::string, boost::shared_ptr<Link> > m_linkTable; // all emulated links
+  std::map<std::string, boost::shared_ptr<LossTrace> > m_lossTraces; // by path
 };
 
 } // namespace emulator
@@ -11,12 +11,13 @@ Face::Face (const int faceId, boost::shared_ptr<Node>& node,
   , m_nodeId (node->GetId ())
   , m_node (node)
   , m_ioService (ioService)
+  , m_strand (node->GetStrand ())
 {
   NDNEM_LOG_TRACE ("[Face::Face] (" << m_nodeId << ":" << m_id << ")");
 }
 
 void
-Face::Dispatch (const ndn::Block& blk)
+Face::Dispatch (const ndn::Block& blk, int hopCount, int pathLength)
 {
   NDNEM_LOG_TRACE ("[Face::Dispatch] (" << m_nodeId << ":" << m_id
                    << ") packet type = " << blk.type ());
@@ -24,15 +25,13 @@ Face::Dispatch (const ndn::Block& blk)
     {
       if (blk.type () == ndn::Tlv::Interest)
         {
-          boost::shared_ptr<ndn::Interest> i (boost::make_shared<ndn::Interest> ());
-          i->wireDecode (blk);
-          m_node->HandleInterest (m_id, i);
+          boost::shared_ptr<InterestView> i (boost::make_shared<InterestView> (blk));
+          m_node->HandleInterest (m_id, i, hopCount);
         }
       else if (blk.type () == ndn::Tlv::Data)
         {
-          boost::shared_ptr<ndn::Data> d (boost::make_shared<ndn::Data> ());
-          d->wireDecode (blk);
-          m_node->HandleData (m_id, d);
+          boost::shared_ptr<DataView> d (boost::make_shared<DataView> (blk));
+          m_node->HandleData (m_id, d, hopCount, pathLength);
         }
       else
         throw std::runtime_error ("Unknown NDN packet type");
@@ -40,17 +40,33 @@ public:
     return m_nodeId;
   }
 
+  // Whether the face connects to a local app
+  virtual bool
+  IsLocal () const
+  {
+    return false;
+  }
+
   virtual void
   Send (boost::shared_ptr<Packet>&) = 0;
 
+  // Stop receiving, called when the node removes the face
+  virtual void
+  Close ()
+  {
+  }
+
+  // Hop count and path length are those of the packet
+  // when it arrives, see Packet
   void
-  Dispatch (const ndn::Block&);
+  Dispatch (const ndn::Block&, int hopCount = 0, int pathLength = 0);
 
 protected:
   const int m_id;  // face id
   const std::string& m_nodeId; // node id
   boost::shared_ptr<Node> m_node;
   boost::asio::io_service& m_ioService;
+  boost::asio::io_service::strand& m_strand; // strand of the node
 };
 
 } // namespace emulator
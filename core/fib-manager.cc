@@ -74,7 +74,7 @@ FibManager::SendResponse(const ndn::Name& name,
   responseData->setContent (encodedControl);
 
   m_keyChain.sign (*responseData);
-  m_node->HandleData (0, responseData);
+  m_node->HandleData (0, boost::make_shared<DataView> (responseData->wireEncode ()));
 }
 
 
@@ -1,41 +1,157 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
 #include <sstream>
+#include <vector>
 #include "logging.h"
 #include "fib.h"
 
 namespace emulator {
 namespace node {
 
+void
+Fib::AddRoute (const ndn::Name& prefix, const int faceId)
+{
+  // Research question: Currently we use broadcast when sending packet on
+  // the local link. If we want to use L2 unicast, we need to include L2
+  // addresses in the L3 routing table. Is that necessary for sensor networks,
+  // given that the wireless channel is already broadcast in nature?
+
+  fib_type::iterator it = m_fib.find (prefix);
+  if (it == m_fib.end ())
+    {
+      it = m_fib.insert (std::make_pair (prefix, FibEntry ())).first;
+      m_prefixes.insert (prefix);
+      m_prefixLengths[prefix.size ()]++;
+
+      // Inherit the faces of the parent prefixes
+      for (std::size_t i = 0; i < prefix.size (); i++)
+        {
+          fib_type::iterator pit = m_fib.find (prefix.getPrefix (i));
+          if (pit == m_fib.end ())
+            continue;
+
+          std::set<int>::iterator fit;
+          for (fit = pit->second.nexthops.begin (); fit != pit->second.nexthops.end (); fit++)
+            {
+              it->second.faces[*fit]++;
+            }
+        }
+    }
+
+  if (it->second.nexthops.insert (faceId).second)
+    {
+      this->Inherit (prefix, faceId, 1);
+      m_faceRoutes[faceId].insert (prefix);
+    }
+}
+
+void
+Fib::RemoveRoute (const ndn::Name& prefix, const int faceId)
+{
+  fib_type::iterator it = m_fib.find (prefix);
+  if (it == m_fib.end () || it->second.nexthops.erase (faceId) == 0)
+    return;
+
+  this->Inherit (prefix, faceId, -1);
+
+  if (it->second.nexthops.empty ())
+    {
+      // Descendants did not inherit anything from this entry
+      m_fib.erase (it);
+      m_prefixes.erase (prefix);
+      std::map<std::size_t, std::size_t>::iterator lit = m_prefixLengths.find (prefix.size ());
+      if (--lit->second == 0)
+        m_prefixLengths.erase (lit);
+    }
+}
+
+void
+Fib::Inherit (const ndn::Name& prefix, const int faceId, const int delta)
+{
+  std::set<ndn::Name>::iterator it;
+  for (it = m_prefixes.lower_bound (prefix);
+       it != m_prefixes.end () && prefix.isPrefixOf (*it); it++)
+    {
+      std::map<int, int>& faces = m_fib.find (*it)->second.faces;
+      if ((faces[faceId] += delta) == 0)
+        faces.erase (faceId);
+    }
+}
+
+void
+Fib::CleanUp (const int faceId)
+{
+  std::map<int, std::set<ndn::Name> >::iterator it = m_faceRoutes.find (faceId);
+  if (it == m_faceRoutes.end ())
+    return;
+
+  std::set<ndn::Name> prefixes;
+  prefixes.swap (it->second);
+  m_faceRoutes.erase (it);
+
+  std::set<ndn::Name>::iterator pit;
+  for (pit = prefixes.begin (); pit != prefixes.end (); pit++)
+    {
+      this->RemoveRoute (*pit, faceId);
+    }
+}
+
 void
 Fib::LookUp (const ndn::Name& name, std::set<int>& out)
 {
-  // If we use longest prefix match, we need to inherit
-  // outgoing faces from parent prefixes. Or we don't
-  // inherit but use "match-all" semantics. This allows
-  // simpler "add/delete route" operations but will
-  // make lookup operation very slow. Therefore we
-  // should use "LPM with inheritance" semantics for
-  // faster lookup speed.
-
-  for (int i = name.size (); i >= 0; i--)
-    {
-      ndn::Name prefix = name.getPrefix (i);
-      fib_type::iterator it = m_fib.find (prefix);
-      if (it != m_fib.end ())
-	{
-	  // Found match, stop now and copy all faces to "out"
-	  std::set<int>& faces = it->second;
+  // We use "LPM with inheritance" semantics: each entry already holds
+  // the outgoing faces of its parent prefixes, so the lookup can stop at
+  // the longest match. Only the prefix lengths present in the table are
+  // probed, using prefix hashes computed incrementally over the name.
+
+  std::map<std::size_t, std::size_t>::reverse_iterator lit (m_prefixLengths.upper_bound (name.size ()));
+  if (lit == m_prefixLengths.rend ())
+    return;
+
+  const std::size_t maxLength = lit->first;
+  std::size_t localHashes[32];
+  std::vector<std::size_t> longHashes;
+  std::size_t* hashes = localHashes;
+  if (maxLength >= 32)
+    {
+      longHashes.resize (maxLength + 1);
+      hashes = &longHashes[0];
+    }
+
+  hashes[0] = 0;
+  for (std::size_t i = 0; i < maxLength; i++)
+    {
+      hashes[i + 1] = hashes[i];
+      ndn_name_hash::combine (hashes[i + 1], name[i]);
+    }
+
+  for (; lit != m_prefixLengths.rend (); lit++)
+    {
+      const std::size_t length = lit->first;
+      fib_type::iterator it = m_fib.find (ndn_name_prefix (name, length, hashes[length]),
+                                          ndn_name_prefix_hash (), ndn_name_prefix_equal ());
+      if (it == m_fib.end ())
+        continue;
+
+      // Found match, stop now and copy all faces to "out"
+      std::map<int, int>& faces = it->second.faces;
+      std::map<int, int>::iterator fit;
+      for (fit = faces.begin (); fit != faces.end (); fit++)
+        {
+          out.insert (fit->first);
+        }
+
+      if (__NDNEM_LOG_LEVEL__ <= TRACE)
+        {
           std::stringstream ss;
-	  ss << "[Fib::LookUp] (" << m_nodeId << ") " << name << " ->";
-	  std::set<int>::iterator fit;
-	  for (fit = faces.begin (); fit != faces.end (); fit++)
-	    {
-	      ss << " " << *fit;
-	    }
+          ss << "[Fib::LookUp] (" << m_nodeId << ") " << name << " ->";
+          for (fit = faces.begin (); fit != faces.end (); fit++)
+            {
+              ss << " " << fit->first;
+            }
           NDNEM_LOG_TRACE (ss.str ());
-	  out.insert (faces.begin (), faces.end ());
-	}
+        }
+      return;
     }
 }
 
@@ -46,7 +162,7 @@ Fib::Print (const std::string& pad)
   for (it = m_fib.begin (); it != m_fib.end (); it++)
     {
       std::cout << pad << it->first << " -> faces:";
-      std::set<int>& faces = it->second;
+      std::set<int>& faces = it->second.nexthops;
       std::set<int>::iterator fit;
       for (fit = faces.begin (); fit != faces.end (); fit++)
 	{
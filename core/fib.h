@@ -5,6 +5,7 @@
 
 #include <ndn-cxx/name.hpp>
 #include <boost/unordered_map.hpp>
+#include <map>
 #include <set>
 #include <iostream>
 
@@ -13,6 +14,15 @@
 namespace emulator {
 namespace node {
 
+class FibEntry {
+public:
+  // Faces registered on this very prefix
+  std::set<int> nexthops;
+  // Faces registered on this prefix or any of its ancestors in the table,
+  // with the number of such prefixes each face is registered on
+  std::map<int, int> faces;
+};
+
 class Fib {
 public:
   explicit
@@ -21,38 +31,13 @@ public:
   {
   }
 
-  typedef boost::unordered_map<ndn::Name, std::set<int>, ndn_name_hash> fib_type;
+  typedef boost::unordered_map<ndn::Name, FibEntry, ndn_name_hash> fib_type;
 
   void
-  AddRoute (const ndn::Name& prefix, const int faceId)
-  {
-    // Research question: Currently we use broadcast when sending packet on
-    // the local link. If we want to use L2 unicast, we need to include L2
-    // addresses in the L3 routing table. Is that necessary for sensor networks,
-    // given that the wireless channel is already broadcast in nature?
-
-    m_fib[prefix].insert (faceId);
-
-    //TODO: inherit from parent prefixes
-  }
+  AddRoute (const ndn::Name&, const int);
 
   void
-  CleanUp (const int faceId)
-  {
-    fib_type::iterator it = m_fib.begin ();
-    while (it != m_fib.end ())
-      {
-        it->second.erase (faceId);
-        if (it->second.empty ())
-          {
-            it = m_fib.erase (it);
-          }
-        else
-          {
-            it++;
-          }
-      }
-  }
+  CleanUp (const int);
 
   void
   LookUp (const ndn::Name&, std::set<int>&);
@@ -60,10 +45,28 @@ public:
   void
   Print (const std::string& = "");
 
+private:
+  void
+  RemoveRoute (const ndn::Name&, const int);
+
+  // Add delta to the count of the face in the entries
+  // of the prefix and all its descendants
+  void
+  Inherit (const ndn::Name&, const int, const int);
+
 private:
   const std::string& m_nodeId;
   //TODO: support cost for each route
-  boost::unordered_map<ndn::Name, std::set<int>, ndn_name_hash> m_fib;
+  boost::unordered_map<ndn::Name, FibEntry, ndn_name_hash> m_fib;
+  // Prefixes in canonical order, where the descendants
+  // of a prefix immediately follow the prefix itself
+  std::set<ndn::Name> m_prefixes;
+  // Number of prefixes with each length, so that lookups
+  // only probe the name prefixes that can match
+  std::map<std::size_t, std::size_t> m_prefixLengths;
+  // Prefixes registered on each face, so that removing
+  // a face does not need to scan the whole table
+  std::map<int, std::set<ndn::Name> > m_faceRoutes;
 };
 
 } // namespace node
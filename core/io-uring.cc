@@ -0,0 +1,283 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifdef NDNEM_HAVE_IO_URING
+
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "io-uring.h"
+#include "logging.h"
+
+namespace emulator {
+
+const unsigned IoUring::QUEUE_DEPTH = 256;
+const unsigned IoUring::COMPLETION_BATCH = 64;
+const unsigned IoUring::BUFFER_COUNT = 1024;
+const std::size_t IoUring::BUFFER_SIZE = 4096;
+
+static const int BUFFER_GROUP = 0;
+
+IoUring::IoUring (boost::asio::io_service& ioService)
+  : m_ioService (ioService)
+  , m_event (ioService)
+  , m_bufferRing (0)
+  , m_buffers (BUFFER_COUNT * BUFFER_SIZE)
+  , m_requestCounter (0)
+  , m_isSubmitPending (false)
+  , m_buffersHeld (0)
+{
+  // Leave room for the completions of the multishot requests
+  struct io_uring_params params;
+  std::memset (&params, 0, sizeof (params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = 8 * QUEUE_DEPTH;
+  int ret = io_uring_queue_init_params (QUEUE_DEPTH, &m_ring, &params);
+  if (ret < 0)
+    throw std::runtime_error ("[IoUring::IoUring] cannot set up the ring: "
+                              + std::string (std::strerror (-ret)));
+
+  int event = ::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (event < 0)
+    ret = -errno;
+  else
+    ret = io_uring_register_eventfd (&m_ring, event);
+  if (ret < 0)
+    {
+      if (event >= 0)
+        ::close (event);
+      io_uring_queue_exit (&m_ring);
+      throw std::runtime_error ("[IoUring::IoUring] cannot set up the eventfd: "
+                                + std::string (std::strerror (-ret)));
+    }
+  m_event.assign (event);
+
+  m_bufferRing = io_uring_setup_buf_ring (&m_ring, BUFFER_COUNT, BUFFER_GROUP, 0, &ret);
+  if (m_bufferRing == 0)
+    {
+      io_uring_queue_exit (&m_ring);
+      throw std::runtime_error ("[IoUring::IoUring] cannot register the buffers: "
+                                + std::string (std::strerror (-ret)));
+    }
+  for (unsigned i = 0; i < BUFFER_COUNT; i++)
+    {
+      io_uring_buf_ring_add (m_bufferRing, &m_buffers[i * BUFFER_SIZE], BUFFER_SIZE, i,
+                             io_uring_buf_ring_mask (BUFFER_COUNT), i);
+    }
+  io_uring_buf_ring_advance (m_bufferRing, BUFFER_COUNT);
+
+  NDNEM_LOG_DEBUG ("[IoUring::IoUring] " << QUEUE_DEPTH << " entries, "
+                   << BUFFER_COUNT << " buffers of " << BUFFER_SIZE << " bytes");
+  this->WaitForCompletions ();
+}
+
+IoUring::~IoUring ()
+{
+  // Ignore errors
+  boost::system::error_code error;
+  m_event.close (error);
+  io_uring_free_buf_ring (&m_ring, m_bufferRing, BUFFER_COUNT, BUFFER_GROUP);
+  io_uring_queue_exit (&m_ring);
+}
+
+uint64_t
+IoUring::Accept (int fd, const Handler& handler)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  struct io_uring_sqe* sqe = this->GetSqe ();
+  io_uring_prep_multishot_accept (sqe, fd, 0, 0, SOCK_CLOEXEC);
+  return this->AddRequest (sqe, handler);
+}
+
+uint64_t
+IoUring::Receive (int fd, const Handler& handler)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  struct io_uring_sqe* sqe = this->GetSqe ();
+  io_uring_prep_recv_multishot (sqe, fd, 0, 0, 0);
+  sqe->flags |= IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  return this->AddRequest (sqe, handler);
+}
+
+uint64_t
+IoUring::SendMsg (int fd, const struct msghdr* msg, const Handler& handler)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  struct io_uring_sqe* sqe = this->GetSqe ();
+  // Have the kernel retry short writes on the stream
+  io_uring_prep_sendmsg (sqe, fd, msg, MSG_NOSIGNAL | MSG_WAITALL);
+  return this->AddRequest (sqe, handler);
+}
+
+void
+IoUring::Cancel (uint64_t request)
+{
+  // Destroyed after the lock is released, as it may hold the last
+  // reference to a face
+  Handler handler;
+
+  boost::mutex::scoped_lock lock (m_mutex);
+  std::map<uint64_t, Handler>::iterator it = m_handlers.find (request);
+  if (it == m_handlers.end ())
+    return;  // already over
+
+  handler.swap (it->second);
+  m_handlers.erase (it);
+
+  struct io_uring_sqe* sqe = this->GetSqe ();
+  io_uring_prep_cancel64 (sqe, request, 0);
+  // Requests start at 1, so the completion of the cancel is ignored
+  io_uring_sqe_set_data64 (sqe, 0);
+  this->ScheduleSubmit ();
+}
+
+void
+IoUring::ReleaseBuffer (uint16_t bufferId)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  this->RecycleBuffer (bufferId);
+}
+
+void
+IoUring::WaitForBuffer (const boost::function<void ()>& handler)
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  // Completions are reaped in order, so the buffers taken before a
+  // receive ran out are all held at this point. If they are all back
+  // already, the ring has buffers again.
+  if (m_buffersHeld == 0)
+    m_ioService.post (handler);
+  else
+    m_bufferWaiters.push_back (handler);
+}
+
+struct io_uring_sqe*
+IoUring::GetSqe ()
+{
+  struct io_uring_sqe* sqe = io_uring_get_sqe (&m_ring);
+  if (sqe == 0)
+    {
+      // The queue is full. Submit the batch so far right away.
+      io_uring_submit (&m_ring);
+      sqe = io_uring_get_sqe (&m_ring);
+      if (sqe == 0)
+        throw std::runtime_error ("[IoUring::GetSqe] submission queue full");
+    }
+  return sqe;
+}
+
+uint64_t
+IoUring::AddRequest (struct io_uring_sqe* sqe, const Handler& handler)
+{
+  uint64_t request = ++m_requestCounter;
+  io_uring_sqe_set_data64 (sqe, request);
+  m_handlers[request] = handler;
+  this->ScheduleSubmit ();
+  return request;
+}
+
+void
+IoUring::ScheduleSubmit ()
+{
+  // Requests made until the submit handler runs go in the same batch
+  if (!m_isSubmitPending)
+    {
+      m_isSubmitPending = true;
+      m_ioService.post (boost::bind (&IoUring::Submit, this));
+    }
+}
+
+void
+IoUring::RecycleBuffer (uint16_t bufferId)
+{
+  io_uring_buf_ring_add (m_bufferRing, &m_buffers[bufferId * BUFFER_SIZE], BUFFER_SIZE,
+                         bufferId, io_uring_buf_ring_mask (BUFFER_COUNT), 0);
+  io_uring_buf_ring_advance (m_bufferRing, 1);
+  m_buffersHeld--;
+
+  for (std::size_t i = 0; i < m_bufferWaiters.size (); i++)
+    {
+      m_ioService.post (m_bufferWaiters[i]);
+    }
+  m_bufferWaiters.clear ();
+}
+
+void
+IoUring::Submit ()
+{
+  boost::mutex::scoped_lock lock (m_mutex);
+  m_isSubmitPending = false;
+  int ret = io_uring_submit (&m_ring);
+  if (ret < 0)
+    NDNEM_LOG_ERROR ("[IoUring::Submit] error = " << std::strerror (-ret));
+}
+
+void
+IoUring::WaitForCompletions ()
+{
+  m_event.async_read_some (boost::asio::null_buffers (),
+                           boost::bind (&IoUring::HandleCompletions, this, _1));
+}
+
+void
+IoUring::HandleCompletions (const boost::system::error_code& error)
+{
+  if (error)
+    {
+      NDNEM_LOG_TRACE ("[IoUring::HandleCompletions] error = " << error.message ());
+      return;
+    }
+
+  // Reset the eventfd before reaping, so that later completions wake us up again
+  uint64_t count;
+  if (::read (m_event.native_handle (), &count, sizeof (count)) < 0 && errno != EAGAIN)
+    NDNEM_LOG_ERROR ("[IoUring::HandleCompletions] cannot read eventfd: "
+                     << std::strerror (errno));
+
+  struct io_uring_cqe* cqes[COMPLETION_BATCH];
+  unsigned n;
+  while ((n = io_uring_peek_batch_cqe (&m_ring, cqes, COMPLETION_BATCH)) > 0)
+    {
+      {
+        boost::mutex::scoped_lock lock (m_mutex);
+        for (unsigned i = 0; i < n; i++)
+          {
+            if (cqes[i]->flags & IORING_CQE_F_BUFFER)
+              m_buffersHeld++;
+
+            std::map<uint64_t, Handler>::iterator it =
+              m_handlers.find (io_uring_cqe_get_data64 (cqes[i]));
+            if (it == m_handlers.end ())
+              {
+                // Not a request of ours, give its buffer back
+                if (cqes[i]->flags & IORING_CQE_F_BUFFER)
+                  this->RecycleBuffer (GetBufferId (cqes[i]->flags));
+                continue;
+              }
+
+            m_completions.push_back (Completion (it->second, cqes[i]->res, cqes[i]->flags));
+            if (!(cqes[i]->flags & IORING_CQE_F_MORE))
+              m_handlers.erase (it);
+          }
+        io_uring_cq_advance (&m_ring, n);
+      }
+
+      // Without the lock, as handlers may make new requests
+      for (std::size_t i = 0; i < m_completions.size (); i++)
+        {
+          m_completions[i].handler (m_completions[i].result, m_completions[i].flags);
+        }
+      m_completions.clear ();
+    }
+
+  this->WaitForCompletions ();
+}
+
+} // namespace emulator
+
+#endif // NDNEM_HAVE_IO_URING
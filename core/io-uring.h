@@ -0,0 +1,154 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __IO_URING_H__
+#define __IO_URING_H__
+
+#ifdef NDNEM_HAVE_IO_URING
+
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <liburing.h>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace emulator {
+
+/*
+ * io_uring backend for the sockets of the app faces (see --io-uring),
+ * one per io_service. Linux only.
+ *
+ * Requests are only queued when they are made, and the whole batch is
+ * submitted at once by a handler posted to the io_service. Completions
+ * are reaped in batches when the eventfd registered with the ring fires.
+ *
+ * Accepts and receives are multishot: one request keeps completing until
+ * it fails or is cancelled. Receives pick their buffer from a ring of
+ * buffers registered with the kernel, which the handler of a completion
+ * has to give back with ReleaseBuffer. A receive finding no buffer fails
+ * with ENOBUFS and is retried with WaitForBuffer.
+ *
+ * Handlers are called with the result of the request (a negative errno
+ * on failure) and the flags of the completion. They run in the thread
+ * reaping the completions, so faces wrap them in their strand, which
+ * keeps the completions of a multishot request in order. A handler is
+ * destroyed after the last completion of its request.
+ */
+class IoUring : boost::noncopyable {
+public:
+  typedef boost::function<void (int, unsigned)> Handler;
+
+  static const unsigned QUEUE_DEPTH;  // submission queue entries
+  static const unsigned COMPLETION_BATCH;  // completions reaped at once
+  static const unsigned BUFFER_COUNT;  // registered receive buffers, power of two
+  static const std::size_t BUFFER_SIZE;  // in bytes
+
+  // Throws std::runtime_error if the kernel does not support io_uring
+  explicit
+  IoUring (boost::asio::io_service& ioService);
+
+  ~IoUring ();
+
+  // Multishot accept. The result is the socket of the new connection.
+  uint64_t
+  Accept (int fd, const Handler& handler);
+
+  // Multishot receive into the registered buffers. The result is the
+  // number of bytes received, 0 when the peer closed the connection.
+  uint64_t
+  Receive (int fd, const Handler& handler);
+
+  // Gather write. The message and its buffers must stay valid until
+  // the handler is called.
+  uint64_t
+  SendMsg (int fd, const struct msghdr* msg, const Handler& handler);
+
+  // Cancel a multishot request. Its handler is dropped right away and
+  // only called for completions already reaped. The request must not
+  // refer to memory of the caller, as the kernel may still use it.
+  void
+  Cancel (uint64_t request);
+
+  // Buffer of a receive completion
+  static uint16_t
+  GetBufferId (unsigned flags)
+  {
+    return flags >> IORING_CQE_BUFFER_SHIFT;
+  }
+
+  const uint8_t*
+  GetBuffer (uint16_t bufferId) const
+  {
+    return &m_buffers[bufferId * BUFFER_SIZE];
+  }
+
+  // Give the buffer back for further receives
+  void
+  ReleaseBuffer (uint16_t bufferId);
+
+  // Call the handler once a buffer is given back, or soon if none is
+  // held by a handler
+  void
+  WaitForBuffer (const boost::function<void ()>& handler);
+
+private:
+  struct Completion {
+    Completion (const Handler& handler, int result, unsigned flags)
+      : handler (handler)
+      , result (result)
+      , flags (flags)
+    {
+    }
+
+    Handler handler;
+    int result;
+    unsigned flags;
+  };
+
+  // GetSqe to RecycleBuffer expect the mutex to be held
+  struct io_uring_sqe*
+  GetSqe ();
+
+  uint64_t
+  AddRequest (struct io_uring_sqe* sqe, const Handler& handler);
+
+  void
+  ScheduleSubmit ();
+
+  void
+  RecycleBuffer (uint16_t bufferId);
+
+  void
+  Submit ();
+
+  void
+  WaitForCompletions ();
+
+  void
+  HandleCompletions (const boost::system::error_code&);
+
+private:
+  boost::asio::io_service& m_ioService;
+  struct io_uring m_ring;
+  boost::asio::posix::stream_descriptor m_event;  // registered with the ring
+  struct io_uring_buf_ring* m_bufferRing;
+  std::vector<uint8_t> m_buffers;
+  std::vector<Completion> m_completions;  // of the batch being handled
+
+  // Protects everything below as well as the submission queue and the
+  // buffer ring, which the strands of all nodes share
+  boost::mutex m_mutex;
+  uint64_t m_requestCounter;
+  std::map<uint64_t, Handler> m_handlers;
+  bool m_isSubmitPending;
+  unsigned m_buffersHeld;  // by the completions reaped so far
+  std::vector<boost::function<void ()> > m_bufferWaiters;
+};
+
+} // namespace emulator
+
+#endif // NDNEM_HAVE_IO_URING
+
+#endif // __IO_URING_H__
@@ -3,39 +3,247 @@
 #ifndef __LINK_ATTRIBUTE_H__
 #define __LINK_ATTRIBUTE_H__
 
+#include <cmath>
 #include <iostream>
-#include <boost/random/mersenne_twister.hpp>
-#include <boost/random/bernoulli_distribution.hpp>
+#include <stdexcept>
+#include <boost/shared_ptr.hpp>
+
+#include "counter-random.h"
+#include "loss-trace.h"
 
 namespace emulator {
 
+/*
+ * Loss of a connection. The random draws are made by the link, see
+ * Link::Transmit. The loss models are:
+ *
+ * - bernoulli: each frame is lost with the same probability (default)
+ * - gilbert-elliott: a two-state Markov chain advanced at each frame,
+ *   with a loss probability for each state, for bursts of losses
+ * - trace: replay of a recorded loss trace, indexed by the time of the
+ *   frame since the start of the emulation
+ *
+ * Except for bernoulli, the loss probability changes from frame to frame,
+ * and is looked up in constant time before each frame.
+ *
+ * A connection may also delay the frames, with a random jitter on top of
+ * a fixed propagation delay, and have a rate of its own, e.g., when the
+ * two directions between a pair of nodes differ. The power at which the
+ * destination hears the frames decides which frame survives a collision,
+ * see Channel.
+ */
 class LinkAttribute {
 public:
-  LinkAttribute ()
-    : m_random (0.0)
+  enum LossModel { BERNOULLI, GILBERT_ELLIOTT, TRACE };
+  enum JitterDistribution { UNIFORM, EXPONENTIAL };
+
+  explicit
+  LinkAttribute (double loss = 0.0)
+    : m_model (BERNOULLI)
+    , m_lossRate (loss)
+    , m_dropThreshold (CounterRandom::GetThreshold (loss))
+    , m_isBad (false)
+    , m_traceInterval (0)
+    , m_delay (0)
+    , m_jitter (0)
+    , m_jitterDistribution (UNIFORM)
+    , m_txRate (0.0)
+    , m_rxPower (0.0)
+  {
+  }
+
+  // Gilbert-Elliott model with the probabilities of leaving the
+  // good and the bad state at each frame
+  LinkAttribute (double goodToBad, double badToGood, double goodLoss, double badLoss)
+    : m_model (GILBERT_ELLIOTT)
+    , m_dropThreshold (CounterRandom::GetThreshold (goodLoss))
+    , m_isBad (false)
+    , m_traceInterval (0)
+    , m_delay (0)
+    , m_jitter (0)
+    , m_jitterDistribution (UNIFORM)
+    , m_txRate (0.0)
+    , m_rxPower (0.0)
+  {
+    m_leaveThresholds[0] = CounterRandom::GetThreshold (goodToBad);
+    m_leaveThresholds[1] = CounterRandom::GetThreshold (badToGood);
+    m_lossThresholds[0] = m_dropThreshold;
+    m_lossThresholds[1] = CounterRandom::GetThreshold (badLoss);
+
+    // Mean loss rate, in the stationary distribution of the states
+    double bad = goodToBad + badToGood > 0.0 ? goodToBad / (goodToBad + badToGood) : 0.0;
+    m_lossRate = (1.0 - bad) * goodLoss + bad * badLoss;
+  }
+
+  // Trace model with the time in us between two samples of the trace
+  LinkAttribute (const boost::shared_ptr<const LossTrace>& trace, int64_t interval)
+    : m_model (TRACE)
+    , m_lossRate (trace->GetLossRate ())
+    , m_dropThreshold (trace->GetDropThreshold (0))
+    , m_isBad (false)
+    , m_trace (trace)
+    , m_traceInterval (interval)
+    , m_delay (0)
+    , m_jitter (0)
+    , m_jitterDistribution (UNIFORM)
+    , m_txRate (0.0)
+    , m_rxPower (0.0)
   {
+    if (m_traceInterval <= 0)
+      throw std::invalid_argument ("[LinkAttribute::LinkAttribute] invalid trace interval");
   }
 
-  LinkAttribute (double loss)
-    : m_random (loss)
+  LossModel
+  GetLossModel () const
   {
+    return m_model;
   }
 
+  const char*
+  GetLossModelName () const
+  {
+    switch (m_model)
+      {
+      case GILBERT_ELLIOTT:
+        return "gilbert-elliott";
+      case TRACE:
+        return "trace";
+      default:
+        return "bernoulli";
+      }
+  }
+
+  // Mean loss rate
   double
   GetLossRate () const
   {
-    return m_random.p ();
+    return m_lossRate;
   }
 
+  // Random numbers below the threshold drop the packet
+  uint64_t
+  GetDropThreshold () const
+  {
+    return m_dropThreshold;
+  }
+
+  // Whether the drop threshold has to be updated before each frame
   bool
-  DropPacket ()
+  IsVarying () const
+  {
+    return m_model != BERNOULLI;
+  }
+
+  // Threshold for a frame sent at the given time, in us since the start
+  // of the emulation. Only to be called by the sender of the frame.
+  uint64_t
+  UpdateDropThreshold (int64_t time, CounterRandom& random)
   {
-    return m_random (m_engine);
+    switch (m_model)
+      {
+      case GILBERT_ELLIOTT:
+        if (random () < m_leaveThresholds[m_isBad])
+          m_isBad = !m_isBad;
+        m_dropThreshold = m_lossThresholds[m_isBad];
+        break;
+      case TRACE:
+        m_dropThreshold = m_trace->GetDropThreshold (time > 0 ? time / m_traceInterval : 0);
+        break;
+      default:
+        break;
+      }
+    return m_dropThreshold;
+  }
+
+  // Propagation delay plus a jitter drawn uniformly in [0, jitter]
+  // or exponentially with mean jitter, in us
+  void
+  SetDelay (long delay, long jitter, JitterDistribution distribution)
+  {
+    if (delay < 0 || jitter < 0)
+      throw std::invalid_argument ("[LinkAttribute::SetDelay] negative delay");
+
+    m_delay = delay;
+    m_jitter = jitter;
+    m_jitterDistribution = distribution;
+  }
+
+  bool
+  HasDelay () const
+  {
+    return m_delay > 0 || m_jitter > 0;
+  }
+
+  long
+  GetMinDelay () const
+  {
+    return m_delay;
+  }
+
+  long
+  GetJitter () const
+  {
+    return m_jitter;
+  }
+
+  // Delay of the next frame, in us
+  long
+  DrawDelay (CounterRandom& random) const
+  {
+    if (m_jitter == 0)
+      return m_delay;
+    if (m_jitterDistribution == EXPONENTIAL)
+      return m_delay + static_cast<long> (-m_jitter * std::log (1.0 - random.Uniform ()));
+    return m_delay + static_cast<long> (random.Uniform () * (m_jitter + 1));
+  }
+
+  // Rate in kbits/s of this direction, 0 for the rate of the link
+  void
+  SetTxRate (double rate)
+  {
+    if (rate < 0.0)
+      throw std::invalid_argument ("[LinkAttribute::SetTxRate] negative rate");
+
+    m_txRate = rate;
+  }
+
+  double
+  GetTxRate () const
+  {
+    return m_txRate;
+  }
+
+  // Power of the frames at the destination, in dBm
+  void
+  SetRxPower (double dbm)
+  {
+    m_rxPower = dbm;
+  }
+
+  double
+  GetRxPower () const
+  {
+    return m_rxPower;
   }
 
 private:
-  boost::random::mt19937 m_engine;
-  boost::random::bernoulli_distribution<> m_random; // random generator with bernoulli distribution
+  LossModel m_model;
+  double m_lossRate;
+  uint64_t m_dropThreshold;  // for the next frame
+
+  // Gilbert-Elliott state, indexed by m_isBad
+  bool m_isBad;
+  uint64_t m_leaveThresholds[2];
+  uint64_t m_lossThresholds[2];
+
+  boost::shared_ptr<const LossTrace> m_trace;
+  int64_t m_traceInterval;  // in us
+
+  long m_delay;  // in us
+  long m_jitter;  // in us
+  JitterDistribution m_jitterDistribution;
+  double m_txRate;  // in kbits/s
+  double m_rxPower;  // in dBm
 };
 
 inline std::ostream&
@@ -5,7 +5,7 @@
 #include "link-face.h"
 #include "link.h"
 #include "node.h"
-#include <boost/random/random_device.hpp>
+#include <algorithm>
 #include <iomanip>
 
 namespace emulator {
@@ -15,26 +15,34 @@ const int LinkDevice::BACKOFF_PERIOD = 20 * LinkDevice::SYMBOL_TIME;  // in us
 const int LinkDevice::MIN_BE = 3;
 const int LinkDevice::MAX_BE = 5;
 const int LinkDevice::MAX_CSMA_BACKOFFS = 4;
+const int LinkDevice::CCA_TIME = 8 * LinkDevice::SYMBOL_TIME;  // in us
 
 LinkDevice::LinkDevice (const std::string& id,
                         const uint64_t macAddr,
 			boost::shared_ptr<Link>& link,
 			boost::shared_ptr<Node>& node,			
-			boost::asio::io_service& ioService,
+			Scheduler& scheduler,
 			const std::size_t txLimit)
   : m_id (id)
   , m_macAddr (macAddr)
   , m_nodeId (node->GetId ())
   , m_link (link)
+  , m_linkIndex (-1)
   , m_node (node)
-  , m_ioService (ioService)
-  , m_rxTimer (ioService)
-  , m_csmaTimer (ioService)
+  , m_scheduler (scheduler)
+  , m_ioService (scheduler.GetIoService ())
+  , m_strand (node->GetStrand ())
+  , m_rxTimer (scheduler, m_strand)
+  , m_csmaTimer (scheduler, m_strand)
+  , m_arrivalTimer (scheduler, m_strand)
+  , m_arrivalCounter (0)
   , m_state (IDLE) // PhyState.IDLE
+  , m_rxSender (-1)
+  , m_rxAirtime (0)
+  , m_rxPower (0.0)
   , m_txQueueLimit (txLimit)
+  , m_random (CounterRandom::Mix (CounterRandom::Hash (link->GetId () + "/" + m_nodeId)))
 {
-  boost::random::random_device rng;
-  m_engine.seed (rng ());
   NDNEM_LOG_TRACE ("[LinkDevice::LinkDevice] (" << m_nodeId
 		   << ":" << m_id << ") attached to link " << m_link->GetId ()
 		   << ", mac addr 0x" << std::hex << std::setfill ('0')
@@ -54,51 +62,95 @@ LinkDevice::AddBroadcastFace ()
                    << " to remote mac 0xffff");
 }
 
+long
+LinkDevice::GetRxDelay (const boost::chrono::system_clock::time_point& rxStart, long airtime)
+{
+  // The frame may have been on the air for a while when we learn about it
+  // (e.g., from another partition), so only wait for the remaining airtime
+  long elapsed = static_cast<long>
+    (boost::chrono::duration_cast<boost::chrono::microseconds>
+     (m_scheduler.Now () - rxStart).count ());
+  return std::max (airtime - elapsed, 0L);
+}
+
+void
+LinkDevice::ScheduleRx (const boost::shared_ptr<const Packet>& pkt, int sender,
+                        const boost::chrono::system_clock::time_point& rxStart, long airtime,
+                        double power)
+{
+  bool isFirst = m_arrivals.empty () || rxStart < m_arrivals.top ().rxStart;
+
+  Arrival a;
+  a.rxStart = rxStart;
+  a.sequence = m_arrivalCounter++;
+  a.pkt = pkt;
+  a.sender = sender;
+  a.airtime = airtime;
+  a.power = power;
+  m_arrivals.push (a);
+
+  if (isFirst)
+    this->SetArrivalTimer ();
+}
+
 void
-LinkDevice::StartRx (const boost::shared_ptr<Packet>& pkt)
+LinkDevice::SetArrivalTimer ()
+{
+  long delay = static_cast<long>
+    (boost::chrono::duration_cast<boost::chrono::microseconds>
+     (m_arrivals.top ().rxStart - m_scheduler.Now ()).count ()) + CCA_TIME;
+
+  // Cancels the wait for a later frame, if any
+  m_arrivalTimer.expires_from_now (boost::posix_time::microseconds (std::max (delay, 0L)));
+  m_arrivalTimer.async_wait
+    (boost::bind (&LinkDevice::HandleArrivals, this, _1));
+}
+
+void
+LinkDevice::HandleArrivals (const boost::system::error_code& error)
+{
+  if (error)
+    return;  // an earlier frame came in
+
+  boost::chrono::system_clock::time_point detected =
+    m_scheduler.Now () - boost::chrono::microseconds (CCA_TIME);
+  while (!m_arrivals.empty () && m_arrivals.top ().rxStart <= detected)
+    {
+      Arrival a = m_arrivals.top ();
+      m_arrivals.pop ();
+      this->StartRx (a.pkt, a.sender, a.rxStart, a.airtime, a.power);
+    }
+
+  if (!m_arrivals.empty ())
+    this->SetArrivalTimer ();
+}
+
+void
+LinkDevice::StartRx (const boost::shared_ptr<const Packet>& pkt, int sender,
+                     const boost::chrono::system_clock::time_point& rxStart, long airtime,
+                     double power)
 {
   NDNEM_LOG_TRACE ("[LinkDevice::StartRx] (" << m_nodeId << ":" << m_id
                    << ") prior state = " << PhyStateToString (m_state));
   switch (m_state)
     {
     case IDLE:
-      {
-        m_state = RX;
-        m_pendingRx = pkt;
-        std::size_t pkt_len = pkt->GetLength ();
-        long delay = static_cast<long>
-          ((static_cast<double> (pkt_len) * 8.0 * 1E6
-            / (m_link->GetTxRate () * 1024.0)));
-
-        NDNEM_LOG_TRACE ("[LinkDevice::StartRx] (" << m_nodeId << ":" << m_id
-                         << ") set rx timer in " << delay << " us");
-
-        m_rxTimer.expires_from_now (boost::posix_time::microseconds (delay));
-        m_rxTimer.async_wait
-          (boost::bind (&LinkDevice::PostRx, this, _1));
-      }
+      this->LockRx (pkt, sender, rxStart, airtime, power);
       break;
 
     case RX:
-    case RX_COLLIDE:
-      {
-        NDNEM_LOG_TRACE ("[LinkDevice::StartRx] (" << m_nodeId << ":" << m_id
-                         << ") called while in RX/RX_COLLIDE");
-        m_state = RX_COLLIDE;
-        m_pendingRx = pkt;
-        std::size_t pkt_len = pkt->GetLength ();
-        long delay = static_cast<long>
-          ((static_cast<double> (pkt_len) * 8.0 * 1E6
-            / (m_link->GetTxRate () * 1024.0)));
-
+      // Stay on the frame being received, unless the new one is strong
+      // enough to take the receiver over. Either way, the channel tells
+      // at the end whether the frame survived the overlap.
+      if (power >= m_rxPower * m_link->GetChannel ().GetCaptureRatio ())
+        {
+          NDNEM_LOG_TRACE ("[LinkDevice::StartRx] (" << m_nodeId << ":" << m_id
+                           << ") captured by a stronger frame while in RX");
+          this->LockRx (pkt, sender, rxStart, airtime, power);
+        }
+      else
         NDNEM_LOG_TRACE ("[LinkDevice::StartRx] (" << m_nodeId << ":" << m_id
-                         << ") set rx timer in " << delay << " us");
-
-        // Cancel previous timer and set new timer based on the new packet size
-        m_rxTimer.expires_from_now (boost::posix_time::microseconds (delay));
-        m_rxTimer.async_wait
-          (boost::bind (&LinkDevice::PostRx, this, _1));
-      }
+                         << ") called while in RX");
       break;
 
     case TX:
@@ -118,6 +170,28 @@ LinkDevice::StartRx (const boost::shared_ptr<Packet>& pkt)
                    << ") after state = " << PhyStateToString (m_state));
 }
 
+void
+LinkDevice::LockRx (const boost::shared_ptr<const Packet>& pkt, int sender,
+                    const boost::chrono::system_clock::time_point& rxStart, long airtime,
+                    double power)
+{
+  m_state = RX;
+  m_pendingRx = pkt;
+  m_rxSender = sender;
+  m_rxStart = rxStart;
+  m_rxAirtime = airtime;
+  m_rxPower = power;
+  long delay = this->GetRxDelay (rxStart, airtime);
+
+  NDNEM_LOG_TRACE ("[LinkDevice::LockRx] (" << m_nodeId << ":" << m_id
+                   << ") set rx timer in " << delay << " us");
+
+  // Cancels the timer of the previous frame, if any
+  m_rxTimer.expires_from_now (boost::posix_time::microseconds (delay));
+  m_rxTimer.async_wait
+    (boost::bind (&LinkDevice::PostRx, this, _1));
+}
+
 void
 LinkDevice::PostRx (const boost::system::error_code& error)
 {
@@ -134,6 +208,15 @@ LinkDevice::PostRx (const boost::system::error_code& error)
     {
     case RX:
       {
+        // Decide on the frames that overlapped the one being received
+        if (!m_link->GetChannel ().IsCaptured (m_linkIndex, m_rxSender, m_rxStart, m_rxAirtime,
+                                               m_rxPower, m_scheduler.Now ()))
+          {
+            NDNEM_LOG_INFO ("[LinkDevice::PostRx] (" << m_nodeId << ":" << m_id
+                            << ") RX failed due to packet collision");
+            break;
+          }
+
         const uint64_t dst = m_pendingRx->GetDst ();
 	const uint64_t src = m_pendingRx->GetSrc ();
         const ndn::Block& wire = m_pendingRx->GetBlock ();
@@ -156,15 +239,13 @@ LinkDevice::PostRx (const boost::system::error_code& error)
 	    else
 	      face = it->second;
 
-	    // Post the message asynchronously
-	    m_ioService.post (boost::bind (&Face::Dispatch, face, wire));
+	    // Post the message asynchronously, one more link crossed
+	    m_strand.post (boost::bind (&Face::Dispatch, face, wire,
+	                                m_pendingRx->GetHopCount () + 1,
+	                                m_pendingRx->GetPathLength ()));
 	  }
       }
       break;
-    case RX_COLLIDE:
-      NDNEM_LOG_INFO ("[LinkDevice::PostRx] (" << m_nodeId << ":" << m_id
-                      << ") RX failed due to packet collision");
-      break;
     case IDLE:
       // There are some cases where the callback is still raised when
       // it should have been cancelled. This may happen when the delay
@@ -173,7 +254,8 @@ LinkDevice::PostRx (const boost::system::error_code& error)
       // In that case, the state may have been already set to IDLE by the
       // previous execution of PostRx (which should have been cancelled).
       // In order not to crash the emulator, we have to allow for this case
-      // as a special hack to get around the problem.
+      // as a special hack to get around the problem. (This never happens
+      // in virtual-time mode, where timer cancellation is exact.)
       NDNEM_LOG_INFO ("[LinkDevice::PostRx] (" << m_nodeId << ":" << m_id
                       << ") called when the state is IDLE");
       break;
@@ -187,6 +269,7 @@ LinkDevice::PostRx (const boost::system::error_code& error)
 
   // Clear PHY state
   m_state = IDLE;
+  m_pendingRx.reset ();
   NDNEM_LOG_TRACE ("[LinkDevice::PostRx] (" << m_nodeId << ":" << m_id
                    << ") after state = " << PhyStateToString (m_state));
 }
@@ -225,8 +308,7 @@ LinkDevice::StartCsma ()
                    << ") start CCA");
 
   int NB = 0, BE = LinkDevice::MIN_BE;
-  boost::random::uniform_int_distribution<> rand (0, (1 << BE) - 1);
-  long backoff = rand (m_engine) * LinkDevice::BACKOFF_PERIOD;
+  long backoff = this->GetBackoff (BE);
 
   NDNEM_LOG_TRACE ("[LinkDevice::StartCsma] (" << m_nodeId << ":" << m_id
                    << ") set csma timer in " << backoff << " us for CCA");
@@ -254,66 +336,64 @@ LinkDevice::DoCsma (int NB, int BE, const boost::system::error_code& error)
   switch (m_state)
     {
     case IDLE:
-      {
-        NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
-                         << ") channel clear after " << NB << " backoffs. Start Tx");
-        m_state = TX;
-
-        // Send the message to the link asynchronously
-        boost::shared_ptr<Packet>& pkt = m_txQueue.front ();
-        m_ioService.post (boost::bind (&Link::Transmit, m_link, m_nodeId, pkt));
-
-        // Set timer to clear TX state later
-        std::size_t pkt_len = pkt->GetLength ();
-        long delay = static_cast<long>
-          ((static_cast<double> (pkt_len) * 8.0 * 1E6
-            / (m_link->GetTxRate () * 1024.0)));
-
-        NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
-                         << ") set csma timer in " << delay << " us for TX");
-
-        m_csmaTimer.expires_from_now (boost::posix_time::microseconds (delay));
-        m_csmaTimer.async_wait
-          (boost::bind (&LinkDevice::DoCsma, this, -1, -1, _1));
-      }
-      break;
-
     case RX:
-    case RX_COLLIDE:
-      {
-        NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
-                         << ") channel busy after " << NB << " backoffs");
-        NB = NB + 1;
-        if (NB > LinkDevice::MAX_CSMA_BACKOFFS)
-          {
-            NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
-                             << ") reach max backoff. Give up Tx");
-            m_txQueue.pop_front ();
+      // Clear channel assessment on the frames on the air at the device,
+      // including those its strand has not handled yet
+      if (m_state == IDLE && !m_link->GetChannel ().IsBusy (m_linkIndex, m_scheduler.Now ()))
+        {
+          NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
+                           << ") channel clear after " << NB << " backoffs. Start Tx");
+          m_state = TX;
 
-            // Leave m_state as it is. RX path will reset it back to IDLE
+          // Send the message to the link asynchronously
+          boost::shared_ptr<Packet>& pkt = m_txQueue.front ();
+          m_strand.post (boost::bind (&Link::Transmit, m_link, m_linkIndex, pkt,
+                                      m_scheduler.Now ()));
 
-            // Should we clear the entire queue?
-            if (m_txQueue.size () != 0)
-              {
-                // Schedule tx of the next packet in queue
-                this->StartCsma ();
-              }
+          // Set timer to clear TX state later
+          long delay = m_link->GetTxDelay (pkt->GetLength ());
 
-            return;
-          }
-        BE = BE + 1;
-        if (BE > LinkDevice::MAX_BE)
-          BE = LinkDevice::MAX_BE;
-        boost::random::uniform_int_distribution<> rand (0, (1 << BE) - 1);
-        long backoff = rand (m_engine) * LinkDevice::BACKOFF_PERIOD;
-
-        NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
-                         << ") set csma timer in " << backoff << " us for backoff");
-
-        m_csmaTimer.expires_from_now (boost::posix_time::microseconds (backoff));
-        m_csmaTimer.async_wait
-          (boost::bind (&LinkDevice::DoCsma, this, NB, BE, _1));
-      }
+          NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
+                           << ") set csma timer in " << delay << " us for TX");
+
+          m_csmaTimer.expires_from_now (boost::posix_time::microseconds (delay));
+          m_csmaTimer.async_wait
+            (boost::bind (&LinkDevice::DoCsma, this, -1, -1, _1));
+        }
+      else
+        {
+          NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
+                           << ") channel busy after " << NB << " backoffs");
+          NB = NB + 1;
+          if (NB > LinkDevice::MAX_CSMA_BACKOFFS)
+            {
+              NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
+                               << ") reach max backoff. Give up Tx");
+              m_txQueue.pop_front ();
+
+              // Leave m_state as it is. RX path will reset it back to IDLE
+
+              // Should we clear the entire queue?
+              if (m_txQueue.size () != 0)
+                {
+                  // Schedule tx of the next packet in queue
+                  this->StartCsma ();
+                }
+
+              return;
+            }
+          BE = BE + 1;
+          if (BE > LinkDevice::MAX_BE)
+            BE = LinkDevice::MAX_BE;
+          long backoff = this->GetBackoff (BE);
+
+          NDNEM_LOG_TRACE ("[LinkDevice::DoCsma] (" << m_nodeId << ":" << m_id
+                           << ") set csma timer in " << backoff << " us for backoff");
+
+          m_csmaTimer.expires_from_now (boost::posix_time::microseconds (backoff));
+          m_csmaTimer.async_wait
+            (boost::bind (&LinkDevice::DoCsma, this, NB, BE, _1));
+        }
       break;
 
     case TX:
@@ -342,4 +422,11 @@ LinkDevice::DoCsma (int NB, int BE, const boost::system::error_code& error)
                    << ") after state = " << PhyStateToString (m_state));
 }
 
+long
+LinkDevice::GetBackoff (int BE)
+{
+  // The same in every run, whatever the partitions
+  return static_cast<long> (m_random () >> (64 - BE)) * LinkDevice::BACKOFF_PERIOD;
+}
+
 } // namespace emulator
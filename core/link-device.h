@@ -6,11 +6,12 @@
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
 #include <boost/enable_shared_from_this.hpp>
-#include <boost/random/mersenne_twister.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
 #include <deque>
+#include <queue>
 
+#include "counter-random.h"
 #include "packet.h"
+#include "scheduler.h"
 
 namespace emulator {
 
@@ -24,7 +25,7 @@ public:
               const uint64_t macAddr,
 	      boost::shared_ptr<Link>& link,
 	      boost::shared_ptr<Node>& node,			
-	      boost::asio::io_service& ioService,
+	      Scheduler& scheduler,
 	      const std::size_t txLimit = 5);
 
   // CSMA/CA constants
@@ -33,12 +34,14 @@ public:
   static const int MIN_BE;
   static const int MAX_BE;
   static const int MAX_CSMA_BACKOFFS;
+  // Time for the PHY to detect a frame after its start, in us. Neither
+  // carrier sense nor reception see the frame before.
+  static const int CCA_TIME;
 
   enum PhyState {
     IDLE = 0,
     TX,
     RX,
-    RX_COLLIDE,
     SLEEP = 254,
     FAILURE = 255
   };
@@ -54,8 +57,6 @@ public:
         return "TX";
       case RX:
         return "RX";
-      case RX_COLLIDE:
-        return "RX_COLLIDE";
       case SLEEP:
         return "SLEEP";
       case FAILURE:
@@ -77,6 +78,25 @@ public:
     return m_macAddr;
   }
 
+  Scheduler&
+  GetScheduler ()
+  {
+    return m_scheduler;
+  }
+
+  // Set by the link when the device is attached, see Link::Transmit
+  void
+  SetLinkIndex (int index)
+  {
+    m_linkIndex = index;
+  }
+
+  boost::asio::io_service::strand&
+  GetStrand ()
+  {
+    return m_strand;
+  }
+
   boost::optional<boost::shared_ptr<LinkFace> >
   GetLinkFace (uint64_t remoteMac)
   {
@@ -91,13 +111,38 @@ public:
   void
   AddBroadcastFace ();
 
+  // The frame of the device with the given index on the link starts at
+  // the given time, lasts the given number of us and is heard with the
+  // given power in mW. Whether it survives the other frames on the air
+  // is decided by the channel of the link at the end of the frame.
+  void
+  StartRx (const boost::shared_ptr<const Packet>&, int,
+           const boost::chrono::system_clock::time_point&, long, double);
+
+  // Same as StartRx once the frame is detected, in real-time mode. The
+  // frames wait in a queue with a single timer.
   void
-  StartRx (const boost::shared_ptr<Packet>&);
+  ScheduleRx (const boost::shared_ptr<const Packet>&, int,
+              const boost::chrono::system_clock::time_point&, long, double);
 
   void
   StartTx (boost::shared_ptr<Packet>&);
 
 private:
+  long
+  GetRxDelay (const boost::chrono::system_clock::time_point&, long);
+
+  // Receive the given frame until its end, see StartRx
+  void
+  LockRx (const boost::shared_ptr<const Packet>&, int,
+          const boost::chrono::system_clock::time_point&, long, double);
+
+  void
+  SetArrivalTimer ();
+
+  void
+  HandleArrivals (const boost::system::error_code&);
+
   void
   PostRx (const boost::system::error_code&);
 
@@ -107,21 +152,56 @@ private:
   void
   DoCsma (int, int, const boost::system::error_code&);
 
+  // Random backoff of 0 to 2^BE - 1 periods, in us
+  long
+  GetBackoff (int BE);
+
+private:
+  // Frame on its way to the device, see ScheduleRx
+  struct Arrival {
+    boost::chrono::system_clock::time_point rxStart;
+    uint64_t sequence;  // keeps frames arriving at the same time in order
+    boost::shared_ptr<const Packet> pkt;
+    int sender;
+    long airtime;
+    double power;
+
+    // Earliest arrival first in a priority queue
+    bool
+    operator< (const Arrival& other) const
+    {
+      if (rxStart != other.rxStart)
+        return rxStart > other.rxStart;
+      return sequence > other.sequence;
+    }
+  };
+
 private:
   const std::string m_id;
   const uint64_t m_macAddr;
   const std::string& m_nodeId;
   boost::shared_ptr<Link> m_link;
+  int m_linkIndex;  // on m_link
   boost::shared_ptr<Node> m_node;
 
+  Scheduler& m_scheduler;
   boost::asio::io_service& m_ioService;
-  boost::asio::deadline_timer m_rxTimer;  // emulating transmission delay
-  boost::asio::deadline_timer m_csmaTimer; // implementing CSMA algorithm
+  boost::asio::io_service::strand& m_strand; // strand of the node
+  Timer m_rxTimer;  // emulating transmission delay
+  Timer m_csmaTimer; // implementing CSMA algorithm
+  Timer m_arrivalTimer;  // for the first frame in m_arrivals
+  std::priority_queue<Arrival> m_arrivals;
+  uint64_t m_arrivalCounter;
   PhyState m_state;
-  boost::shared_ptr<Packet> m_pendingRx;
+  // Frame being received
+  boost::shared_ptr<const Packet> m_pendingRx;
+  int m_rxSender;
+  boost::chrono::system_clock::time_point m_rxStart;
+  long m_rxAirtime;
+  double m_rxPower;
   std::deque<boost::shared_ptr<Packet> > m_txQueue;  // FIFO queue
   const std::size_t m_txQueueLimit;
-  boost::random::mt19937 m_engine;
+  CounterRandom m_random;  // backoffs, keyed by the link and node ids
 
   std::map<uint64_t, boost::shared_ptr<LinkFace> > m_faces;
 };
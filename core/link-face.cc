@@ -23,8 +23,18 @@ LinkFace::LinkFace (const int faceId, boost::shared_ptr<Node> node,
 inline void
 LinkFace::Send (boost::shared_ptr<Packet>& pkt)
 {
-  pkt->SetDst (m_remoteMac);
-  m_device->StartTx (pkt);
+  // Address the frame in place, unless it is also queued on another face
+  // (forwarded to several faces): then address a copy of the frame
+  if (pkt.unique ())
+    {
+      pkt->SetDst (m_remoteMac);
+      m_device->StartTx (pkt);
+      return;
+    }
+
+  boost::shared_ptr<Packet> frame (Packet::Create (*pkt));
+  frame->SetDst (m_remoteMac);
+  m_device->StartTx (frame);
 }
 
 
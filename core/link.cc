@@ -1,30 +1,193 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 #include "link-device.h"
 #include "link.h"
 
 namespace emulator {
 
+// Index of a node of the link matrix among the devices of the link
+static int
+GetNodeIndex (const std::map<std::string, int>& indices, const std::string& nodeId,
+              const std::string& linkId)
+{
+  std::map<std::string, int>::const_iterator it = indices.find (nodeId);
+  if (it == indices.end ())
+    throw std::runtime_error ("[Link::CompileLinkMatrix] unknown node "
+                              + nodeId + " on link " + linkId);
+  return it->second;
+}
+
+void
+Link::AddNodeDevice (const std::string& nodeId, boost::shared_ptr<LinkDevice>& dev)
+{
+  if (m_nodeTable.find (nodeId) != m_nodeTable.end ())
+    throw std::runtime_error ("[Link::AddNodeDevice] duplicate node "
+                              + nodeId + " on link " + m_id);
+
+  dev->SetLinkIndex (m_devices.size ());
+  m_nodeTable[nodeId] = dev;
+  m_devices.push_back (dev);
+  m_nodeIds.push_back (nodeId);
+}
+
 void
-Link::Transmit (const std::string& nodeId, const boost::shared_ptr<Packet>& pkt)
+Link::CompileLinkMatrix ()
 {
-  // Transmit to other nodes on the link according to link attribute matrix
-  std::map<std::string, boost::shared_ptr<LinkAttribute> >& neighbors = m_linkMatrix[nodeId];
-  std::map<std::string, boost::shared_ptr<LinkAttribute> >::iterator it;
-  for (it = neighbors.begin (); it != neighbors.end (); it++)
+  std::map<std::string, int> indices;
+  for (std::size_t i = 0; i < m_nodeIds.size (); i++)
     {
-      NDNEM_LOG_DEBUG ("[Link::Transmit] (" << m_id << ") " << nodeId << " -> " << it->first
-                       << ", LossRate = " << it->second->GetLossRate ());
-      if (!it->second->DropPacket ())
+      indices[m_nodeIds[i]] = i;
+    }
+
+  // Each device draws from a stream of its own, keyed by the link id,
+  // so that runs are reproducible across builds
+  m_senders.assign (m_devices.size (), Sender ());
+  m_channel.Resize (m_devices.size (), LinkDevice::CCA_TIME);
+  uint64_t seed = CounterRandom::Hash (m_id);
+  for (std::size_t i = 0; i < m_senders.size (); i++)
+    {
+      m_senders[i].random = CounterRandom (CounterRandom::Mix (seed + i));
+      m_senders[i].origin = m_devices[i]->GetScheduler ().Now ();
+      // Mac addresses are unique in the whole network
+      m_senders[i].frameKey = m_devices[i]->GetMacAddr () << 40;
+    }
+
+  std::map<std::string, std::map<std::string, boost::shared_ptr<LinkAttribute> > >::iterator outer;
+  for (outer = m_linkMatrix.begin (); outer != m_linkMatrix.end (); outer++)
+    {
+      int from = GetNodeIndex (indices, outer->first, m_id);
+      Sender& sender = m_senders[from];
+      std::map<std::string, boost::shared_ptr<LinkAttribute> >::iterator inner;
+      for (inner = outer->second.begin (); inner != outer->second.end (); inner++)
         {
-          m_nodeTable[it->first]->StartRx (pkt);
+          Neighbor n;
+          n.index = GetNodeIndex (indices, inner->first, m_id);
+          n.device = m_devices[n.index].get ();
+          n.attribute = inner->second.get ();
+          n.isRemote = &n.device->GetScheduler () != &m_devices[from]->GetScheduler ();
+          n.hasDelay = n.attribute->HasDelay ();
+          double rate = n.attribute->GetTxRate () > 0.0 ? n.attribute->GetTxRate () : m_txRate;
+          n.usPerByte = 8.0 * 1E6 / (rate * 1024.0);
+          n.power = std::pow (10.0, n.attribute->GetRxPower () / 10.0);
+          if (n.attribute->IsVarying ())
+            sender.varying.push_back (sender.neighbors.size ());
+          sender.neighbors.push_back (n);
+          sender.dropThresholds.push_back (n.attribute->GetDropThreshold ());
+        }
+      sender.drops.resize (sender.neighbors.size ());
+    }
+}
+
+long
+Link::GetLookahead () const
+{
+  // Nothing a frame does at a receiver happens before it is detected
+  long delay = -1;
+  for (std::size_t i = 0; i < m_senders.size (); i++)
+    {
+      const std::vector<Neighbor>& neighbors = m_senders[i].neighbors;
+      for (std::size_t j = 0; j < neighbors.size (); j++)
+        {
+          long d = neighbors[j].attribute->GetMinDelay ();
+          if (delay < 0 || d < delay)
+            delay = d;
+        }
+    }
+  return std::max (delay, 0L) + LinkDevice::CCA_TIME;
+}
+
+void
+Link::Transmit (int from, const boost::shared_ptr<const Packet>& pkt,
+                const boost::chrono::system_clock::time_point& txStart)
+{
+  // Transmit to other nodes on the link according to link attribute matrix.
+  // All receivers share the same read-only frame.
+  Sender& sender = m_senders[from];
+  const std::size_t n = sender.neighbors.size ();
+  if (n == 0)
+    return;  // no connection from this node
+
+  if (!sender.varying.empty ())
+    {
+      int64_t time = boost::chrono::duration_cast<boost::chrono::microseconds>
+        (txStart - sender.origin).count ();
+      for (std::size_t j = 0; j < sender.varying.size (); j++)
+        {
+          std::size_t i = sender.varying[j];
+          sender.dropThresholds[i] =
+            sender.neighbors[i].attribute->UpdateDropThreshold (time, sender.random);
+        }
+    }
+
+  // Draw the losses of all receivers at once
+  sender.random.Sample (&sender.dropThresholds[0], &sender.drops[0], n);
+
+  Scheduler& scheduler = m_devices[from]->GetScheduler ();
+  const uint64_t key = sender.frameKey++;
+  for (std::size_t i = 0; i < n; i++)
+    {
+      const Neighbor& nb = sender.neighbors[i];
+      if (sender.drops[i])
+        {
+          NDNEM_LOG_DEBUG ("[Link::Transmit] (" << m_id << ") " << m_nodeIds[from] << " -> "
+                           << m_nodeIds[nb.index] << ": drop packet");
+          continue;
+        }
+
+      // The frame reaches the neighbor after the delay of the connection,
+      // and lasts as long as the rate of the connection makes it
+      boost::chrono::system_clock::time_point rxStart = txStart;
+      if (nb.hasDelay)
+        rxStart += boost::chrono::microseconds (nb.attribute->DrawDelay (sender.random));
+      long airtime = static_cast<long> (pkt->GetLength () * nb.usPerByte);
+      boost::chrono::system_clock::time_point detect =
+        rxStart + boost::chrono::microseconds (LinkDevice::CCA_TIME);
+
+      NDNEM_LOG_DEBUG ("[Link::Transmit] (" << m_id << ") " << m_nodeIds[from] << " -> "
+                       << m_nodeIds[nb.index]);
+      // The devices live as long as the link
+      if (nb.isRemote)
+        {
+          // The receiver belongs to another partition, which gets the
+          // frame at the end of the synchronization window, before it is
+          // detected (see GetLookahead)
+          nb.device->GetScheduler ().PostRemote
+            (detect, key, boost::bind (&Link::ReceiveRemote, this, nb.index, from, pkt,
+                                       rxStart, airtime, nb.power));
+          continue;
+        }
+
+      // The channel shows the frame to the receiver once it is detected,
+      // even before the strand of the receiver handles it
+      m_channel.AddSignal (nb.index, from, rxStart, airtime, nb.power);
+      if (scheduler.IsVirtualTime ())
+        {
+          // Same order of frames and timers as if the receiver were remote
+          scheduler.PostFrame (detect, key, boost::bind (&LinkDevice::StartRx, nb.device, pkt,
+                                                         from, rxStart, airtime, nb.power));
         }
       else
-        NDNEM_LOG_DEBUG ("[Link::Transmit] (" << m_id << ") " << nodeId << " -> " << it->first
-                         << ": drop packet");
+        {
+          // Queue the frame at the receiver until it is detected
+          nb.device->GetStrand ().post (boost::bind (&LinkDevice::ScheduleRx, nb.device, pkt,
+                                                     from, rxStart, airtime, nb.power));
+        }
     }
 }
 
+void
+Link::ReceiveRemote (int to, int from, const boost::shared_ptr<const Packet>& pkt,
+                     const boost::chrono::system_clock::time_point& rxStart, long airtime,
+                     double power)
+{
+  m_channel.AddSignal (to, from, rxStart, airtime, power);
+  m_devices[to]->StartRx (pkt, from, rxStart, airtime, power);
+}
+
 void
 Link::PrintLinkMatrix (const std::string& pad)
 {
@@ -37,7 +200,17 @@ Link::PrintLinkMatrix (const std::string& pad)
         {
           std::cout << pad << "from " << outer->first
                     << " to " << inner->first << ", LossRate = "
-                    << inner->second->GetLossRate () << std::endl;
+                    << inner->second->GetLossRate ();
+          if (inner->second->GetLossModel () != LinkAttribute::BERNOULLI)
+            std::cout << " (" << inner->second->GetLossModelName () << ")";
+          if (inner->second->HasDelay ())
+            std::cout << ", Delay = " << inner->second->GetMinDelay ()
+                      << " us + " << inner->second->GetJitter () << " us jitter";
+          if (inner->second->GetTxRate () > 0.0)
+            std::cout << ", TxRate = " << inner->second->GetTxRate () << " kbits/s";
+          if (inner->second->GetRxPower () != 0.0)
+            std::cout << ", RxPower = " << inner->second->GetRxPower () << " dBm";
+          std::cout << std::endl;
         }
     }
 }
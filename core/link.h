@@ -5,6 +5,7 @@
 
 #include <map>
 #include <exception>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/chrono/system_clocks.hpp>
 #include <boost/function.hpp>
@@ -14,7 +15,10 @@
 #include <boost/utility.hpp>
 
 #include "logging.h"
+#include "channel.h"
+#include "counter-random.h"
 #include "link-attribute.h"
+#include "packet.h"
 
 namespace emulator {
 
@@ -47,12 +51,25 @@ public:
     return m_mtu;
   }
 
-  void
-  AddNodeDevice (const std::string& nodeId, boost::shared_ptr<LinkDevice>& dev)
+  // Airtime in us of a frame with the given length
+  long
+  GetTxDelay (std::size_t length) const
+  {
+    return static_cast<long>
+      ((static_cast<double> (length) * 8.0 * 1E6 / (m_txRate * 1024.0)));
+  }
+
+  // State of the medium shared by the devices
+  Channel&
+  GetChannel ()
   {
-    m_nodeTable[nodeId] = dev;
+    return m_channel;
   }
 
+  // Attach the device of a node. The device learns its index on the link.
+  void
+  AddNodeDevice (const std::string& nodeId, boost::shared_ptr<LinkDevice>& dev);
+
   boost::shared_ptr<LinkDevice>
   GetNodeDevice (const std::string& nodeId)
   {
@@ -83,8 +100,20 @@ public:
     m_linkMatrix[from][to] = attr;
   }
 
+  // Turn the link matrix into the neighbor lists used by Transmit.
+  // To be called once all devices and connections are added.
   void
-  Transmit (const std::string&, const boost::shared_ptr<Packet>&);
+  CompileLinkMatrix ();
+
+  // Shortest time from the start of a frame to its detection by any
+  // neighbor, in us. Only valid once the matrix is compiled.
+  long
+  GetLookahead () const;
+
+  // Hand the frame to the neighbors of the device with the given index
+  void
+  Transmit (int, const boost::shared_ptr<const Packet>&,
+            const boost::chrono::system_clock::time_point&);
 
   void
   PrintLinkMatrix (const std::string& = "");
@@ -93,16 +122,53 @@ public:
   PrintInfo ()
   {
     std::cout << "Link id: " << m_id << std::endl;
+    std::cout << "  CaptureThreshold: " << m_channel.GetCaptureThreshold () << " dB" << std::endl;
     std::cout << "  LinkMatrix: " << std::endl;
     this->PrintLinkMatrix ("    ");
   }
 
+private:
+  // Add the frame from another partition to the channel when the
+  // receiver detects it, and start its reception
+  void
+  ReceiveRemote (int, int, const boost::shared_ptr<const Packet>&,
+                 const boost::chrono::system_clock::time_point&, long, double);
+
+private:
+  // Receiver of the frames of a device
+  struct Neighbor {
+    LinkDevice* device;
+    LinkAttribute* attribute;
+    int index;  // of the device on the link
+    bool isRemote;  // in another partition than the sender
+    bool hasDelay;
+    double usPerByte;  // airtime at the rate of the connection
+    double power;  // at the receiver, in mW
+  };
+
+  // Neighbors of a device. Only used on the strand of the device.
+  struct Sender {
+    std::vector<Neighbor> neighbors;
+    std::vector<uint64_t> dropThresholds;  // of the neighbors
+    std::vector<uint8_t> drops;  // drawn for the current frame
+    std::vector<std::size_t> varying;  // neighbors whose threshold changes per frame
+    CounterRandom random;
+    boost::chrono::system_clock::time_point origin;  // start of the loss traces
+    uint64_t frameKey;  // of the next frame, see Scheduler::PostFrame
+  };
+
 private:
   const std::string m_id; // link id
   const double m_txRate; // in kbits/s
   const std::size_t m_mtu;  // in bytes
   std::map<std::string, boost::shared_ptr<LinkDevice> > m_nodeTable; // nodes on the link
   std::map<std::string, std::map<std::string, boost::shared_ptr<LinkAttribute> > > m_linkMatrix;
+
+  // Devices by index, and the neighbors of each device, compiled from the tables above
+  std::vector<boost::shared_ptr<LinkDevice> > m_devices;
+  std::vector<std::string> m_nodeIds;
+  std::vector<Sender> m_senders;
+  Channel m_channel;
 };
 
 } // namespace emulator
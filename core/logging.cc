@@ -3,3 +3,6 @@
 #include "logging.h"
 
 int __NDNEM_LOG_LEVEL__ = INFO;
+
+boost::posix_time::ptime (*__NDNEM_LOG_CLOCK__) () =
+  &boost::posix_time::microsec_clock::local_time;
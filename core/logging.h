@@ -18,6 +18,10 @@ enum {
 
 extern int __NDNEM_LOG_LEVEL__;
 
+// Time source for log timestamps. Points to the virtual clock
+// when the emulator runs in virtual-time mode.
+extern boost::posix_time::ptime (*__NDNEM_LOG_CLOCK__) ();
+
 inline int
 GetLogLevelFromString (std::string& level)
 {
@@ -39,37 +43,37 @@ GetLogLevelFromString (std::string& level)
 
 #define NDNEM_LOG_TRACE(stream)                                         \
   if (__NDNEM_LOG_LEVEL__ <= TRACE) {                                   \
-    std::cout << boost::posix_time::microsec_clock::local_time ()       \
+    std::cout << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [TRACE] " << stream << std::endl;                    \
   } else ((void)0)
 
 #define NDNEM_LOG_DEBUG(stream)                                         \
   if (__NDNEM_LOG_LEVEL__ <= DEBUG) {                                   \
-    std::cout << boost::posix_time::microsec_clock::local_time ()       \
+    std::cout << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [DEBUG] " << stream << std::endl;                    \
   } else ((void)0)
 
 #define NDNEM_LOG_INFO(stream)                                          \
   if (__NDNEM_LOG_LEVEL__ <= INFO) {                                    \
-    std::cout << boost::posix_time::microsec_clock::local_time ()       \
+    std::cout << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [INFO] " << stream << std::endl;                     \
   } else ((void)0)
 
 #define NDNEM_LOG_WARNING(stream)                                       \
   if (__NDNEM_LOG_LEVEL__ <= WARNING) {                                 \
-    std::cerr << boost::posix_time::microsec_clock::local_time ()       \
+    std::cerr << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [WARN] " << stream << std::endl;                     \
   } else ((void)0)
 
 #define NDNEM_LOG_ERROR(stream)                                         \
   if (__NDNEM_LOG_LEVEL__ <= ERROR) {                                   \
-    std::cerr << boost::posix_time::microsec_clock::local_time ()       \
+    std::cerr << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [ERROR] " << stream << std::endl;                    \
   } else ((void)0)
 
 #define NDNEM_LOG_FATAL(stream)                                         \
   if (__NDNEM_LOG_LEVEL__ <= FATAL) {                                   \
-    std::cerr << boost::posix_time::microsec_clock::local_time ()       \
+    std::cerr << __NDNEM_LOG_CLOCK__ ()                                 \
               << " [FATAL] " << stream << std::endl;                    \
   } else ((void)0)
 
@@ -0,0 +1,47 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/filesystem.hpp>
+#include <stdexcept>
+
+#include "counter-random.h"
+#include "logging.h"
+#include "loss-trace.h"
+
+namespace emulator {
+
+// Refuse empty traces before trying to map them
+static const char*
+CheckFile (const std::string& path)
+{
+  boost::system::error_code error;
+  boost::uintmax_t size = boost::filesystem::file_size (path, error);
+  if (error || size == 0)
+    throw std::runtime_error ("[LossTrace::LossTrace] empty or missing trace " + path);
+  return path.c_str ();
+}
+
+LossTrace::LossTrace (const std::string& path)
+  : m_path (path)
+  , m_file (CheckFile (path), boost::interprocess::read_only)
+  , m_region (m_file, boost::interprocess::read_only)
+  , m_samples (static_cast<const uint8_t*> (m_region.get_address ()))
+  , m_size (m_region.get_size ())
+  , m_lossRate (0.0)
+{
+  for (int i = 0; i < 256; i++)
+    {
+      m_thresholds[i] = CounterRandom::GetThreshold (i / 255.0);
+    }
+
+  uint64_t sum = 0;
+  for (std::size_t i = 0; i < m_size; i++)
+    {
+      sum += m_samples[i];
+    }
+  m_lossRate = static_cast<double> (sum) / (255.0 * m_size);
+
+  NDNEM_LOG_DEBUG ("[LossTrace::LossTrace] " << m_path << ": " << m_size
+                   << " samples, mean loss rate " << m_lossRate);
+}
+
+} // namespace emulator
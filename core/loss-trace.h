@@ -0,0 +1,69 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __LOSS_TRACE_H__
+#define __LOSS_TRACE_H__
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/utility.hpp>
+#include <stdint.h>
+#include <string>
+
+namespace emulator {
+
+/*
+ * Recorded loss of a connection, replayed by the trace loss model of
+ * LinkAttribute. The file is a sequence of samples taken at a fixed
+ * interval, one byte each, giving the loss probability in units of 1/255
+ * (0 never drops, 255 always drops). Recorded RSSI values, or the outcome
+ * of each probe, are converted to this scale beforehand.
+ *
+ * The file is mapped read-only and shared by all connections replaying
+ * it, and looking up a sample is an index into the mapping.
+ */
+class LossTrace : boost::noncopyable {
+public:
+  // Throws std::runtime_error if the file cannot be used
+  explicit
+  LossTrace (const std::string& path);
+
+  const std::string&
+  GetPath () const
+  {
+    return m_path;
+  }
+
+  // Number of samples, the trace restarts after the last one
+  std::size_t
+  GetSize () const
+  {
+    return m_size;
+  }
+
+  // Drop threshold of the given sample, see CounterRandom::GetThreshold
+  uint64_t
+  GetDropThreshold (std::size_t sample) const
+  {
+    return m_thresholds[m_samples[sample % m_size]];
+  }
+
+  // Mean loss probability over the trace
+  double
+  GetLossRate () const
+  {
+    return m_lossRate;
+  }
+
+private:
+  const std::string m_path;
+  boost::interprocess::file_mapping m_file;
+  boost::interprocess::mapped_region m_region;
+  const uint8_t* m_samples;
+  std::size_t m_size;
+  double m_lossRate;
+  uint64_t m_thresholds[256];  // by sample value
+};
+
+} // namespace emulator
+
+#endif // __LOSS_TRACE_H__
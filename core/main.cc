@@ -14,6 +14,10 @@ int
 run (int argc, char* argv[])
 {
   std::string log_level;
+  bool virtual_time = false;
+  bool io_uring = false;
+  int threads;
+  int partitions;
   po::options_description desc ("Allowed options");
   desc.add_options ()
     ("help,h", "print help message")
@@ -22,6 +26,14 @@ run (int argc, char* argv[])
      "logging level (trace, debug, info, warning, error, fatal)")
     ("config-file,c", po::value<std::string> (),
      "configuration file path")
+    ("virtual-time", po::bool_switch (&virtual_time),
+     "run the emulation in virtual time instead of wall clock time")
+    ("threads,t", po::value<int> (&threads)->default_value (1),
+     "number of worker threads (real-time mode only)")
+    ("partitions,p", po::value<int> (&partitions)->default_value (1),
+     "number of partitions run in parallel (virtual-time mode only)")
+    ("io-uring", po::bool_switch (&io_uring),
+     "drive the sockets of the apps with io_uring (Linux only)")
     ;
 
   po::variables_map vm;
@@ -37,7 +49,7 @@ run (int argc, char* argv[])
 
   __NDNEM_LOG_LEVEL__ = GetLogLevelFromString (log_level);
 
-  Emulator em;
+  Emulator em (virtual_time, threads, partitions, io_uring);
   em.ReadNetworkConfig (vm["config-file"].as<std::string> ());
 
   NDNEM_LOG_INFO ("[::run] emulation start");
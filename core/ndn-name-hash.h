@@ -10,15 +10,77 @@
 namespace emulator {
 namespace node {
 
+/*
+ * Hashes the wire encoding of a name component by component, so that
+ * the hashes of all prefixes of a name can be computed in a single pass
+ * without creating the prefix names.
+ */
 struct ndn_name_hash
   : std::unary_function<ndn::Name, std::size_t>
 {
   std::size_t operator() (const ndn::Name& n) const
   {
-    const ndn::Block& b = n.wireEncode ();
-    const uint8_t* wire = b.wire ();
-    std::size_t size = b.size ();
-    return boost::hash_range (wire, wire + size);
+    std::size_t seed = 0;
+    for (std::size_t i = 0; i < n.size (); i++)
+      {
+        combine (seed, n[i]);
+      }
+    return seed;
+  }
+
+  static void
+  combine (std::size_t& seed, const ndn::Name::Component& c)
+  {
+    const uint8_t* wire = c.wire ();
+    boost::hash_range (seed, wire, wire + c.size ());
+  }
+};
+
+/*
+ * Refers to the prefix of a name with the given number of components,
+ * for lookups in hash tables keyed by ndn::Name without creating the
+ * prefix. The hash must be computed with ndn_name_hash::combine.
+ */
+struct ndn_name_prefix
+{
+  ndn_name_prefix (const ndn::Name& n, std::size_t l, std::size_t h)
+    : name (n)
+    , length (l)
+    , hash (h)
+  {
+  }
+
+  const ndn::Name& name;
+  std::size_t length;
+  std::size_t hash;
+};
+
+struct ndn_name_prefix_hash
+{
+  std::size_t operator() (const ndn_name_prefix& p) const
+  {
+    return p.hash;
+  }
+};
+
+struct ndn_name_prefix_equal
+{
+  bool operator() (const ndn_name_prefix& p, const ndn::Name& n) const
+  {
+    if (n.size () != p.length)
+      return false;
+
+    for (std::size_t i = 0; i < p.length; i++)
+      {
+        if (n[i] != p.name[i])
+          return false;
+      }
+    return true;
+  }
+
+  bool operator() (const ndn::Name& n, const ndn_name_prefix& p) const
+  {
+    return (*this) (p, n);
   }
 };
 
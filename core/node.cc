@@ -1,8 +1,11 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
 #include "node.h"
+#include "io-uring.h"
 
 #include <boost/filesystem.hpp>
+#include <cerrno>
+#include <cstring>
 #include <iomanip>
 #include <ndn-cxx/interest.hpp>
 #include <ndn-cxx/data.hpp>
@@ -11,6 +14,12 @@ namespace emulator {
 
 Node::~Node ()
 {
+#ifdef NDNEM_HAVE_IO_URING
+  // The handler of the accept refers to this node
+  if (m_acceptRequest != 0)
+    m_ioUring->Cancel (m_acceptRequest);
+#endif
+
   if (m_isListening)
     {
       // Ignore errors
@@ -18,6 +27,13 @@ Node::~Node ()
       m_acceptor.close (error);
       boost::filesystem::remove (m_path, error);
     }
+
+  if (m_shmAcceptor.is_open ())
+    {
+      boost::system::error_code error;
+      m_shmAcceptor.close (error);
+      boost::filesystem::remove (m_shmPath, error);
+    }
 }
 
 void
@@ -31,9 +47,6 @@ Node::Start ()
   m_acceptor.listen ();
   m_isListening = true;
 
-  // Schedule clean up routine for PIT
-  m_pit.ScheduleCleanUp ();
-
   // Get shared pointer to "this"
   boost::shared_ptr<Node> self = this->shared_from_this ();
 
@@ -41,17 +54,39 @@ Node::Start ()
   m_fibManager = boost::make_shared<node::FibManager>
     (0, boost::ref (self), boost::ref (m_fib));
 
-  // Setup cache manager
-  //m_cacheManager.ScheduleCleanUp ();
-
   // Wait for connection from clients
-  int faceId = m_faceCounter++;
-  boost::shared_ptr<AppFace> client =
-    boost::make_shared<AppFace> (faceId, boost::ref (self),
-                                 boost::ref (m_ioService));
+#ifdef NDNEM_HAVE_IO_URING
+  if (m_ioUring != 0)
+    this->StartUringAccept ();
+  else
+#endif
+    {
+      int faceId = m_faceCounter++;
+      boost::shared_ptr<AppFace> client =
+        boost::make_shared<AppFace> (faceId, boost::ref (self),
+                                     boost::ref (m_ioService));
+
+      m_acceptor.async_accept (client->GetSocket (),
+                               m_strand.wrap (boost::bind (&Node::HandleAccept, this,
+                                                           client, _1)));
+    }
 
-  m_acceptor.async_accept (client->GetSocket (),
-			   boost::bind (&Node::HandleAccept, this, client, _1));
+  // Apps using shared memory connect to a socket of their own
+  if (!m_shmPath.empty ())
+    {
+      boost::filesystem::remove (m_shmPath);
+      m_shmAcceptor.open ();
+      m_shmAcceptor.bind (boost::asio::local::stream_protocol::endpoint (m_shmPath));
+      m_shmAcceptor.listen ();
+
+      int faceId = m_faceCounter++;
+      boost::shared_ptr<ShmFace> shmClient =
+        boost::make_shared<ShmFace> (faceId, boost::ref (self),
+                                     boost::ref (m_ioService));
+      m_shmAcceptor.async_accept (shmClient->GetSocket (),
+                                  m_strand.wrap (boost::bind (&Node::HandleShmAccept, this,
+                                                              shmClient, _1)));
+    }
 }
 
 void
@@ -66,7 +101,7 @@ Node::HandleAccept (const boost::shared_ptr<AppFace>& face,
                                  boost::ref (m_ioService));
 
   m_acceptor.async_accept (next->GetSocket (),
-			   boost::bind (&Node::HandleAccept, this, next, _1));
+			   m_strand.wrap (boost::bind (&Node::HandleAccept, this, next, _1)));
 
   // Store accepted face in table
   m_faceTable[face->GetId ()] = face;
@@ -74,6 +109,79 @@ Node::HandleAccept (const boost::shared_ptr<AppFace>& face,
   face->Start ();
 }
 
+void
+Node::HandleShmAccept (const boost::shared_ptr<ShmFace>& face,
+                       const boost::system::error_code& error)
+{
+  if (error)
+    {
+      NDNEM_LOG_ERROR ("[Node::HandleShmAccept] (" << m_id << ") error = "
+                       << error.message ());
+      return;
+    }
+
+  // Wait for the next client to connect
+  int faceId = m_faceCounter++;
+  boost::shared_ptr<Node> self = this->shared_from_this ();
+  boost::shared_ptr<ShmFace> next =
+    boost::make_shared<ShmFace> (faceId, boost::ref (self),
+                                 boost::ref (m_ioService));
+  m_shmAcceptor.async_accept (next->GetSocket (),
+                              m_strand.wrap (boost::bind (&Node::HandleShmAccept, this, next, _1)));
+
+  try
+    {
+      face->Start ();
+      m_faceTable[face->GetId ()] = face;
+    }
+  catch (std::runtime_error& e)
+    {
+      NDNEM_LOG_ERROR ("[Node::HandleShmAccept] (" << m_id << ":" << face->GetId ()
+                       << ") " << e.what ());
+    }
+}
+
+#ifdef NDNEM_HAVE_IO_URING
+
+void
+Node::StartUringAccept ()
+{
+  m_acceptRequest =
+    m_ioUring->Accept (m_acceptor.native_handle (),
+                       m_strand.wrap (boost::bind (&Node::HandleUringAccept, this, _1, _2)));
+}
+
+void
+Node::HandleUringAccept (int result, unsigned flags)
+{
+  if (!(flags & IORING_CQE_F_MORE))
+    m_acceptRequest = 0;
+
+  if (result >= 0)
+    {
+      int faceId = m_faceCounter++;
+      boost::shared_ptr<Node> self = this->shared_from_this ();
+      boost::shared_ptr<AppFace> face =
+        boost::make_shared<AppFace> (faceId, boost::ref (self),
+                                     boost::ref (m_ioService));
+      face->GetSocket ().assign (boost::asio::local::stream_protocol (), result);
+
+      // Store accepted face in table
+      m_faceTable[faceId] = face;
+
+      face->Start (m_ioUring);
+    }
+  else if (result != -ECANCELED)
+    NDNEM_LOG_ERROR ("[Node::HandleUringAccept] (" << m_id << ") error = "
+                     << std::strerror (-result));
+
+  // Keep accepting once the kernel ends the multishot accept
+  if (!(flags & IORING_CQE_F_MORE) && result != -ECANCELED)
+    this->StartUringAccept ();
+}
+
+#endif // NDNEM_HAVE_IO_URING
+
 boost::shared_ptr<LinkDevice>
 Node::AddDevice (const std::string& devId, const uint64_t macAddr,
                  boost::shared_ptr<Link>& link)
@@ -87,7 +195,7 @@ Node::AddDevice (const std::string& devId, const uint64_t macAddr,
     boost::make_shared<LinkDevice> (devId, macAddr,
                                     boost::ref (link),
                                     boost::ref (self),
-                                    boost::ref (m_ioService));
+                                    boost::ref (m_scheduler));
   dev->AddBroadcastFace ();
   
   // Add device to device table
@@ -136,26 +244,36 @@ Node::AddRoute (const std::string& prefix, const std::string& devId, const uint6
 }
 
 void
-Node::HandleInterest (const int faceId, const boost::shared_ptr<ndn::Interest>& i)
+Node::HandleInterest (const int faceId, const boost::shared_ptr<InterestView>& i,
+                      const int hopCount)
 {
-  NDNEM_LOG_DEBUG ("[Node::HandleInterest] (" << m_id << ":" << faceId << ") " << (*i));
+  NDNEM_LOG_DEBUG ("[Node::HandleInterest] (" << m_id << ":" << faceId << ") " << i->GetName ());
+
+  // Drop looping Interests whose PIT entry is already gone
+  if (m_deadNonceList.Has (i->GetName (), i->GetNonce ()))
+    {
+      NDNEM_LOG_DEBUG ("[Node::HandleInterest] (" << m_id << ":" << faceId
+                       << ") Looping Interest with dead nonce " << i->GetNonce ());
+      return;
+    }
 
   // Check cache
-  boost::shared_ptr<ndn::Data> d;
+  boost::shared_ptr<DataView> d;
   if (m_cacheManager.FindMatchingData (i, d))
     {
       NDNEM_LOG_TRACE ("[Node::HandleInterest] (" << m_id << ":" << faceId
                        << ") found match in cache");
-      boost::shared_ptr<Packet> pkt (boost::make_shared<DataPacket> (d));
+      boost::shared_ptr<Packet> pkt (Packet::Create (d->GetWire ()));
+      pkt->SetPathLength (hopCount);
       this->ForwardToFace (pkt, faceId);
       return;
     }
 
   // Record interest in PIT
-  if (m_pit.AddInterest (faceId, i))
+  if (m_pit.AddInterest (faceId, i, hopCount))
     {
       std::set<int> outList;
-      m_fib.LookUp (i->getName (), outList);
+      m_fib.LookUp (i->GetName (), outList);
       /*
        * Currently on-demand faces are differentiated by src mac in the packet,
        * and when link devices send packets, they always set src mac to be their
@@ -172,45 +290,54 @@ Node::HandleInterest (const int faceId, const boost::shared_ptr<ndn::Interest>&
       if (outList.empty ())
         {
           NDNEM_LOG_TRACE ("[Node::HandleInterest] (" << m_id << ":" << faceId
-                           << ") no route to " << i->getName ());
+                           << ") no route to " << i->GetName ());
           return;
         }
 
       std::set<int>::iterator it = outList.find (0);
       if (it != outList.end ())
         {
-          // This interest should go to fib manager
-          m_fibManager->ProcessCommand (faceId, i);
+          // This interest should go to fib manager, which needs it in full
+          m_fibManager->ProcessCommand (faceId, i->Decode ());
         }
       else
         {
           // Forward to faces
-          boost::shared_ptr<Packet> pkt (boost::make_shared<InterestPacket> (i));
+          boost::shared_ptr<Packet> pkt (Packet::Create (i->GetWire ()));
+          pkt->SetHopCount (hopCount);
           this->ForwardToFaces (pkt, outList);
         }
     }
   else
     {
       NDNEM_LOG_DEBUG ("[Node::HandleInterest] (" << m_id << ":" << faceId
-                      << ") Looping Interest with nonce " << i->getNonce ());
+                      << ") Looping Interest with nonce " << i->GetNonce ());
     }
 
   //m_pit.Print ();
 }
 
 void
-Node::HandleData (const int faceId, const boost::shared_ptr<ndn::Data>& d)
+Node::HandleData (const int faceId, const boost::shared_ptr<DataView>& d,
+                  const int hopCount, const int pathLength)
 {
-  NDNEM_LOG_DEBUG ("[Node::HandleData] (" << m_id << ":" << faceId << ") " << d->getName ());
+  NDNEM_LOG_DEBUG ("[Node::HandleData] (" << m_id << ":" << faceId << ") " << d->GetName ());
   std::set<int> outList;
-  m_pit.ConsumeInterestWithDataName (d->getName (), outList);
+  int interestHopCount;
+  m_pit.ConsumeInterestWithDataName (d->GetName (), outList, interestHopCount);
 
   if (!outList.empty ())
     {
+      // For data produced on this node, the path starts here
+      const int length = hopCount == 0 ? interestHopCount : pathLength;
+
       // Cache the data only when we have pending interest for it
-      m_cacheManager.Insert (d);
+      if (m_cacheAdmission.Admit (hopCount, length, this->HasLocalFace (outList)))
+        m_cacheManager.Insert (d);
 
-      boost::shared_ptr<Packet> pkt (boost::make_shared<DataPacket> (d));
+      boost::shared_ptr<Packet> pkt (Packet::Create (d->GetWire ()));
+      pkt->SetHopCount (hopCount);
+      pkt->SetPathLength (length);
       this->ForwardToFaces (pkt, outList);
     }
   else
@@ -221,7 +348,13 @@ void
 Node::RemoveFace (const int faceId)
 {
   NDNEM_LOG_TRACE ("[Node::RemoveFace] (" << m_id << ":" << faceId << ")");
-  m_faceTable.erase (faceId);
+  std::map<int, boost::shared_ptr<Face> >::iterator it = m_faceTable.find (faceId);
+  if (it != m_faceTable.end ())
+    {
+      boost::shared_ptr<Face> face = it->second;
+      m_faceTable.erase (it);
+      face->Close ();
+    }
   m_fibManager->CleanUpFib (faceId);
 }
 
@@ -230,8 +363,13 @@ Node::PrintInfo ()
 {
   std::cout << "Node id: " << m_id << std::endl;
   std::cout << "  Unix socket path: " << m_path << std::endl;
+  if (!m_shmPath.empty ())
+    std::cout << "  Shared-memory socket path: " << m_shmPath << std::endl;
   std::cout << "  Cache limit: " << (m_cacheManager.GetLimit () >> 10)
             << " KB" << std::endl;
+  std::cout << "  Cache policy: " << m_cacheManager.GetPolicyName ()
+            << ", admission: " << m_cacheAdmission.GetName ()
+            << (m_cacheManager.IsPersistent () ? ", persistent" : "") << std::endl;
   std::map<std::string, boost::shared_ptr<LinkDevice> >::iterator it;
   std::cout << "  Device table:" << std::endl;
   for (it = m_deviceTable.begin (); it != m_deviceTable.end (); it++)
@@ -14,6 +14,7 @@
 
 #include "logging.h"
 #include "app-face.h"
+#include "shm-face.h"
 #include "link-face.h"
 #include "link.h"
 #include "link-device.h"
@@ -21,23 +22,36 @@
 #include "fib.h"
 #include "fib-manager.h"
 #include "cache-manager.h"
+#include "cache-admission.h"
+#include "dead-nonce-list.h"
+#include "scheduler.h"
 
 namespace emulator {
 
 class Node : public boost::enable_shared_from_this<Node>, boost::noncopyable {
 public:
-  Node (const std::string& id, const std::string& path,
-        int cacheLimit, boost::asio::io_service& ioService)
+  Node (const std::string& id, const std::string& path, const std::string& shmPath,
+        std::size_t cacheLimit, const std::string& cachePolicy, const std::string& cacheLog,
+        const std::string& cacheAdmission, double cacheProbability,
+        Scheduler& scheduler)
     : m_id (id)
     , m_path (path)
     , m_endpoint (m_path)
-    , m_ioService (ioService)
-    , m_acceptor (ioService)
+    , m_scheduler (scheduler)
+    , m_ioService (scheduler.GetIoService ())
+    , m_strand (m_ioService)
+    , m_acceptor (m_ioService)
     , m_isListening (false)
+    , m_shmPath (shmPath)
+    , m_shmAcceptor (m_ioService)
+    , m_ioUring (0)
+    , m_acceptRequest (0)
     , m_faceCounter (1)  // face id 0 is reserved for fib manager
-    , m_pit (10000, ioService)  // Cleanup Pit every 10 sec
+    , m_deadNonceList (scheduler, m_strand)
+    , m_pit (scheduler, m_strand, m_deadNonceList)
     , m_fib (m_id)
-    , m_cacheManager (m_id, cacheLimit, ioService)
+    , m_cacheManager (m_id, cacheLimit, cachePolicy, cacheLog, scheduler, m_strand)
+    , m_cacheAdmission (cacheAdmission, cacheProbability)
   {
   }
 
@@ -55,6 +69,13 @@ public:
     return m_path;
   }
 
+  // All handlers of the node and its devices and faces run on this strand
+  boost::asio::io_service::strand&
+  GetStrand ()
+  {
+    return m_strand;
+  }
+
   boost::shared_ptr<LinkDevice>
   AddDevice (const std::string&, const uint64_t, boost::shared_ptr<Link>&);
 
@@ -79,14 +100,26 @@ public:
   void
   RemoveFace (const int);
 
+  // Accept apps and drive their sockets with io_uring. Only with
+  // NDNEM_HAVE_IO_URING, and before Start.
+  void
+  SetIoUring (IoUring* ioUring)
+  {
+    m_ioUring = ioUring;
+  }
+
   void
   Start ();
 
+  // The hop count and path length of packets from
+  // local apps are 0, see Packet
   void
-  HandleInterest (const int, const boost::shared_ptr<ndn::Interest>&);
+  HandleInterest (const int, const boost::shared_ptr<InterestView>&,
+                  const int = 0);
 
   void
-  HandleData (const int, const boost::shared_ptr<ndn::Data>&);
+  HandleData (const int, const boost::shared_ptr<DataView>&,
+              const int = 0, const int = 0);
 
   void
   PrintInfo ();
@@ -96,6 +129,16 @@ private:
   HandleAccept (const boost::shared_ptr<AppFace>&,
                 const boost::system::error_code&);
 
+  void
+  HandleShmAccept (const boost::shared_ptr<ShmFace>&,
+                   const boost::system::error_code&);
+
+  void
+  StartUringAccept ();
+
+  void
+  HandleUringAccept (int result, unsigned flags);
+
   void
   ForwardToFace (boost::shared_ptr<Packet>& pkt, int outId)
   {
@@ -108,6 +151,19 @@ private:
       fit->second->Send (pkt);
   }
 
+  bool
+  HasLocalFace (const std::set<int>& faces)
+  {
+    std::set<int>::const_iterator it;
+    for (it = faces.begin (); it != faces.end (); it++)
+      {
+        std::map<int, boost::shared_ptr<Face> >::iterator fit = m_faceTable.find (*it);
+        if (fit != m_faceTable.end () && fit->second->IsLocal ())
+          return true;
+      }
+    return false;
+  }
+
   void
   ForwardToFaces (boost::shared_ptr<Packet>& pkt, std::set<int>& out)
   {
@@ -123,9 +179,15 @@ private:
   const std::string m_id; // node id
   const std::string m_path; // unix domain socket path
   boost::asio::local::stream_protocol::endpoint m_endpoint; // local listening endpoint
+  Scheduler& m_scheduler;
   boost::asio::io_service& m_ioService;
+  boost::asio::io_service::strand m_strand;
   boost::asio::local::stream_protocol::acceptor m_acceptor; // local listening socket
   bool m_isListening;
+  const std::string m_shmPath; // unix domain socket path for shared-memory apps, optional
+  boost::asio::local::stream_protocol::acceptor m_shmAcceptor;
+  IoUring* m_ioUring;  // 0 with asio
+  uint64_t m_acceptRequest;  // multishot accept, 0 if none
 
   int m_faceCounter;
   std::map<int, boost::shared_ptr<Face> > m_faceTable;
@@ -133,6 +195,9 @@ private:
   // Layer-2 devices
   std::map<std::string, boost::shared_ptr<LinkDevice> > m_deviceTable;
 
+  // Nonces of Interests that have left the PIT
+  node::DeadNonceList m_deadNonceList;
+
   // PIT
   node::Pit m_pit;
 
@@ -143,6 +208,7 @@ private:
 
   // CS
   node::CacheManager m_cacheManager;
+  node::CacheAdmission m_cacheAdmission;
 };
 
 } // namespace emulator
@@ -0,0 +1,228 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __PACKET_POOL_H__
+#define __PACKET_POOL_H__
+
+#include <boost/thread/tss.hpp>
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace emulator {
+
+/*
+ * Pool of fixed-size blocks with a free list private to each thread, so
+ * that allocating and freeing take no lock. The free lists are refilled
+ * one slab at a time. Each block remembers the free list it came from:
+ * a block freed by another thread goes back to that list through a
+ * lock-free return stack, which the owner takes over as a whole when its
+ * own list runs out. Frames sent from one partition to another thus do
+ * not make the pool of the sender grow. Slabs and free lists are never
+ * given back to the system, since blocks may be freed after the thread
+ * that allocated them has exited.
+ */
+template<std::size_t Size>
+class SlabPool {
+public:
+  static const std::size_t BLOCKS_PER_SLAB = 64;
+
+  static void*
+  Allocate ()
+  {
+    FreeList* list = GetFreeList ();
+    if (list->head == 0)
+      {
+        // Take the blocks the other threads have returned, if any
+        list->head = __atomic_exchange_n (&list->returned, static_cast<FreeBlock*> (0),
+                                          __ATOMIC_ACQUIRE);
+        if (list->head == 0)
+          Refill (list);
+      }
+
+    FreeBlock* b = list->head;
+    list->head = b->next;
+    return reinterpret_cast<char*> (b) + HEADER_SIZE;
+  }
+
+  static void
+  Deallocate (void* p)
+  {
+    FreeBlock* b = reinterpret_cast<FreeBlock*> (static_cast<char*> (p) - HEADER_SIZE);
+    FreeList* owner = b->owner;
+    if (owner == s_freeList.get ())
+      {
+        b->next = owner->head;
+        owner->head = b;
+        return;
+      }
+
+    // Push onto the return stack of the owner. The owner only ever
+    // takes the whole stack, so there is no ABA problem.
+    FreeBlock* head = __atomic_load_n (&owner->returned, __ATOMIC_RELAXED);
+    do
+      {
+        b->next = head;
+      }
+    while (!__atomic_compare_exchange_n (&owner->returned, &head, b, true,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  }
+
+private:
+  struct FreeList;
+
+  // Header in front of each block. The link is only used while the block is free.
+  struct FreeBlock {
+    FreeList* owner;
+    FreeBlock* next;
+  };
+
+  struct FreeList {
+    FreeList ()
+      : head (0)
+      , returned (0)
+    {
+    }
+
+    FreeBlock* head;  // used by the owning thread only
+    FreeBlock* returned;  // pushed by the other threads
+  };
+
+  // Keep the blocks aligned like the memory from operator new
+  static const std::size_t ALIGNMENT = 16;
+  static const std::size_t HEADER_SIZE =
+    (sizeof (FreeBlock) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  static const std::size_t BLOCK_SIZE =
+    HEADER_SIZE + ((Size + ALIGNMENT - 1) & ~(ALIGNMENT - 1));
+
+  static void
+  KeepFreeList (FreeList*)
+  {
+  }
+
+  static FreeList*
+  GetFreeList ()
+  {
+    FreeList* list = s_freeList.get ();
+    if (list == 0)
+      {
+        list = new FreeList ();
+        s_freeList.reset (list);
+      }
+    return list;
+  }
+
+  static void
+  Refill (FreeList* list)
+  {
+    char* slab = static_cast<char*> (::operator new (BLOCK_SIZE * BLOCKS_PER_SLAB));
+    for (std::size_t i = 0; i < BLOCKS_PER_SLAB; i++)
+      {
+        FreeBlock* b = reinterpret_cast<FreeBlock*> (slab + i * BLOCK_SIZE);
+        b->owner = list;
+        b->next = list->head;
+        list->head = b;
+      }
+  }
+
+private:
+  static boost::thread_specific_ptr<FreeList> s_freeList;
+};
+
+template<std::size_t Size>
+boost::thread_specific_ptr<typename SlabPool<Size>::FreeList>
+SlabPool<Size>::s_freeList (&SlabPool<Size>::KeepFreeList);
+
+/*
+ * Standard allocator on top of SlabPool, for use with boost::allocate_shared.
+ * Only single objects come from the pool.
+ */
+template<typename T>
+class PoolAllocator {
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef std::size_t size_type;
+  typedef std::ptrdiff_t difference_type;
+
+  template<typename U>
+  struct rebind {
+    typedef PoolAllocator<U> other;
+  };
+
+  PoolAllocator ()
+  {
+  }
+
+  template<typename U>
+  PoolAllocator (const PoolAllocator<U>&)
+  {
+  }
+
+  pointer
+  address (reference r) const
+  {
+    return &r;
+  }
+
+  const_pointer
+  address (const_reference r) const
+  {
+    return &r;
+  }
+
+  pointer
+  allocate (size_type n, const void* = 0)
+  {
+    if (n == 1)
+      return static_cast<pointer> (SlabPool<sizeof (T)>::Allocate ());
+    return static_cast<pointer> (::operator new (n * sizeof (T)));
+  }
+
+  void
+  deallocate (pointer p, size_type n)
+  {
+    if (n == 1)
+      SlabPool<sizeof (T)>::Deallocate (p);
+    else
+      ::operator delete (p);
+  }
+
+  size_type
+  max_size () const
+  {
+    return std::numeric_limits<size_type>::max () / sizeof (T);
+  }
+
+  void
+  construct (pointer p, const T& v)
+  {
+    new (p) T (v);
+  }
+
+  void
+  destroy (pointer p)
+  {
+    p->~T ();
+  }
+};
+
+template<typename T, typename U>
+inline bool
+operator== (const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+  return true;
+}
+
+template<typename T, typename U>
+inline bool
+operator!= (const PoolAllocator<T>&, const PoolAllocator<U>&)
+{
+  return false;
+}
+
+} // namespace emulator
+
+#endif // __PACKET_POOL_H__
@@ -0,0 +1,143 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/make_shared.hpp>
+#include <cstring>
+
+#include "packet-view.h"
+
+namespace emulator {
+
+typedef ndn::Buffer::const_iterator iterator;
+
+// Read the header of the TLV element at "it". Leaves "value" at the
+// start of its value and "it" at the next element.
+static uint32_t
+ReadElement (iterator& it, const iterator& end, iterator& value)
+{
+  uint32_t type = ndn::Tlv::readType (it, end);
+  uint64_t length = ndn::Tlv::readVarNumber (it, end);
+  if (length > static_cast<uint64_t> (end - it))
+    throw ndn::Tlv::Error ("TLV length exceeds buffer length");
+
+  value = it;
+  it += length;
+  return type;
+}
+
+static uint64_t
+ReadInteger (iterator value, const iterator& end)
+{
+  return ndn::Tlv::readNonNegativeInteger (end - value, value, end);
+}
+
+InterestView::InterestView (const ndn::Block& wire)
+  : m_wire (wire)
+  , m_nonce (0)
+  , m_lifetime (ndn::DEFAULT_INTEREST_LIFETIME)
+  , m_mustBeFresh (false)
+{
+  if (m_wire.type () != ndn::Tlv::Interest)
+    throw ndn::Tlv::Error ("[InterestView::InterestView] not an Interest");
+
+  if (!this->Parse ())
+    {
+      // ndn-cxx draws a random nonce when asked for a missing one. Put it
+      // in the wire encoding, so that the next hops see the same nonce.
+      ndn::Interest interest;
+      interest.wireDecode (m_wire);
+      interest.getNonce ();
+      m_wire = interest.wireEncode ();
+      this->Parse ();
+    }
+}
+
+bool
+InterestView::Parse ()
+{
+  bool hasNonce = false;
+  iterator it = m_wire.value_begin ();
+  iterator end = m_wire.value_end ();
+  while (it != end)
+    {
+      iterator begin = it;
+      iterator value;
+      switch (ReadElement (it, end, value))
+        {
+        case ndn::Tlv::Name:
+          m_name = ndn::Name (ndn::Block (m_wire, begin, it));
+          break;
+        case ndn::Tlv::Selectors:
+          while (value != it)
+            {
+              iterator selector;
+              if (ReadElement (value, it, selector) == ndn::Tlv::MustBeFresh)
+                m_mustBeFresh = true;
+            }
+          break;
+        case ndn::Tlv::Nonce:
+          if (it - value != sizeof (m_nonce))
+            throw ndn::Tlv::Error ("[InterestView::InterestView] malformed Nonce");
+          std::memcpy (&m_nonce, &*value, sizeof (m_nonce));
+          hasNonce = true;
+          break;
+        case ndn::Tlv::InterestLifetime:
+          m_lifetime = ndn::time::milliseconds (ReadInteger (value, it));
+          break;
+        default:
+          break;  // not needed for forwarding
+        }
+    }
+  return hasNonce;
+}
+
+boost::shared_ptr<ndn::Interest>
+InterestView::Decode () const
+{
+  boost::shared_ptr<ndn::Interest> i (boost::make_shared<ndn::Interest> ());
+  i->wireDecode (m_wire);
+  return i;
+}
+
+DataView::DataView (const ndn::Block& wire)
+  : m_wire (wire)
+  , m_freshnessPeriod (-1)  // not set
+{
+  if (m_wire.type () != ndn::Tlv::Data)
+    throw ndn::Tlv::Error ("[DataView::DataView] not a Data");
+
+  iterator it = m_wire.value_begin ();
+  iterator end = m_wire.value_end ();
+  while (it != end)
+    {
+      iterator begin = it;
+      iterator value;
+      switch (ReadElement (it, end, value))
+        {
+        case ndn::Tlv::Name:
+          m_name = ndn::Name (ndn::Block (m_wire, begin, it));
+          break;
+        case ndn::Tlv::MetaInfo:
+          while (value != it)
+            {
+              iterator field;
+              if (ReadElement (value, it, field) == ndn::Tlv::FreshnessPeriod)
+                m_freshnessPeriod = ndn::time::milliseconds (ReadInteger (field, value));
+            }
+          break;
+        case ndn::Tlv::Content:
+          return;  // the rest is the signature
+        default:
+          break;
+        }
+    }
+}
+
+boost::shared_ptr<ndn::Data>
+DataView::Decode () const
+{
+  boost::shared_ptr<ndn::Data> d (boost::make_shared<ndn::Data> ());
+  d->wireDecode (m_wire);
+  return d;
+}
+
+} // namespace emulator
@@ -0,0 +1,113 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __PACKET_VIEW_H__
+#define __PACKET_VIEW_H__
+
+#include <boost/shared_ptr.hpp>
+#include <ndn-cxx/interest.hpp>
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/encoding/block.hpp>
+#include <stdint.h>
+
+namespace emulator {
+
+/*
+ * Read-only view of an Interest in wire format. Only the fields used by
+ * the forwarder are parsed: the name, nonce, lifetime and MustBeFresh.
+ * The wire encoding is forwarded as received, so that packets are neither
+ * fully decoded nor encoded again at every hop, except for Interests
+ * without a nonce, which get a random one.
+ */
+class InterestView {
+public:
+  // Throws ndn::Tlv::Error if the packet is malformed
+  explicit
+  InterestView (const ndn::Block& wire);
+
+  const ndn::Block&
+  GetWire () const
+  {
+    return m_wire;
+  }
+
+  const ndn::Name&
+  GetName () const
+  {
+    return m_name;
+  }
+
+  uint32_t
+  GetNonce () const
+  {
+    return m_nonce;
+  }
+
+  const ndn::time::milliseconds&
+  GetInterestLifetime () const
+  {
+    return m_lifetime;
+  }
+
+  bool
+  GetMustBeFresh () const
+  {
+    return m_mustBeFresh;
+  }
+
+  // Fully decode the Interest, for the few users that need the other fields
+  boost::shared_ptr<ndn::Interest>
+  Decode () const;
+
+private:
+  // Return false if there is no nonce
+  bool
+  Parse ();
+
+private:
+  ndn::Block m_wire;
+  ndn::Name m_name;
+  uint32_t m_nonce;
+  ndn::time::milliseconds m_lifetime;
+  bool m_mustBeFresh;
+};
+
+/*
+ * Read-only view of a Data packet in wire format, with only
+ * the name and freshness period parsed
+ */
+class DataView {
+public:
+  // Throws ndn::Tlv::Error if the packet is malformed
+  explicit
+  DataView (const ndn::Block& wire);
+
+  const ndn::Block&
+  GetWire () const
+  {
+    return m_wire;
+  }
+
+  const ndn::Name&
+  GetName () const
+  {
+    return m_name;
+  }
+
+  const ndn::time::milliseconds&
+  GetFreshnessPeriod () const
+  {
+    return m_freshnessPeriod;
+  }
+
+  boost::shared_ptr<ndn::Data>
+  Decode () const;
+
+private:
+  const ndn::Block m_wire;
+  ndn::Name m_name;
+  ndn::time::milliseconds m_freshnessPeriod;
+};
+
+} // namespace emulator
+
+#endif // __PACKET_VIEW_H__
@@ -3,33 +3,47 @@
 #ifndef __PACKET_H__
 #define __PACKET_H__
 
+#include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
-#include <ndn-cxx/interest.hpp>
-#include <ndn-cxx/data.hpp>
 
-namespace emulator {
+#include "packet-pool.h"
+#include "packet-view.h"
 
-// Wrapper classes for Interest and Data objects.
-// Used by face sending routines.
+namespace emulator {
 
 /*
- * Provide a common base class for NDN packet wrappers
+ * Frame carrying an NDN packet on a link or to a local app: the mac
+ * header and emulation metadata, and the wire encoding of the packet.
+ * The wire buffer is shared and never modified, so a frame can be
+ * copied for each out face, and the same frame handed to every
+ * receiver on a link, without copying the packet.
  */
 class Packet {
-protected:
+public:
+  explicit
   Packet (const ndn::Block& wire)
     : m_dst (0)
     , m_src (0)
+    , m_hopCount (0)
+    , m_pathLength (0)
     , m_wire (wire)
   {
   }
 
-  virtual
-  ~Packet ()
+  // Frames are allocated from a per-thread pool
+  static boost::shared_ptr<Packet>
+  Create (const ndn::Block& wire)
   {
+    return boost::allocate_shared<Packet> (PoolAllocator<Packet> (), wire);
+  }
+
+  // Copy of the frame, sharing the wire buffer
+  static boost::shared_ptr<Packet>
+  Create (const Packet& pkt)
+  {
+    return boost::allocate_shared<Packet> (PoolAllocator<Packet> (), pkt);
   }
 
-public:
   uint64_t
   GetDst () const
   {
@@ -54,6 +68,34 @@ public:
     m_src = src;
   }
 
+  // Number of links crossed since the consumer (Interest)
+  // or since the node that served the data (Data)
+  int
+  GetHopCount () const
+  {
+    return m_hopCount;
+  }
+
+  void
+  SetHopCount (int hopCount)
+  {
+    m_hopCount = hopCount;
+  }
+
+  // Data only: number of links between the node
+  // that served the data and the consumer
+  int
+  GetPathLength () const
+  {
+    return m_pathLength;
+  }
+
+  void
+  SetPathLength (int pathLength)
+  {
+    m_pathLength = pathLength;
+  }
+
   const ndn::Block&
   GetBlock () const
   {
@@ -78,52 +120,14 @@ public:
     return m_wire.size ();
   }
 
-protected:
+private:
   uint64_t m_dst;
   uint64_t m_src;
-  const ndn::Block& m_wire;
-};
-
-/*
- * Wrapper for Interest packet
- */
-class InterestPacket : public Packet {
-public:
-  InterestPacket (const boost::shared_ptr<ndn::Interest>& i)
-    : Packet (i->wireEncode ())
-    , m_i (i)
-  {
-  }
-
-  const boost::shared_ptr<ndn::Interest>&
-  GetInterest () const
-  {
-    return m_i;
-  }
-
-private:
-  const boost::shared_ptr<ndn::Interest> m_i;
-};
-
-/*
- * Wrapper for Data packet
- */
-class DataPacket : public Packet {
-public:
-  DataPacket (const boost::shared_ptr<ndn::Data>& d)
-    : Packet (d->wireEncode ())
-    , m_d (d)
-  {
-  }
-
-  const boost::shared_ptr<ndn::Data>&
-  GetData () const
-  {
-    return m_d;
-  }
-
-private:
-  const boost::shared_ptr<ndn::Data> m_d;
+  // Emulation metadata travelling with the packet on the link,
+  // like the mac addresses. Not part of the wire encoding.
+  int m_hopCount;
+  int m_pathLength;
+  const ndn::Block m_wire;
 };
 
 } // namespace emulator
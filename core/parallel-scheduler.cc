@@ -0,0 +1,152 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <limits>
+
+#include "logging.h"
+#include "parallel-scheduler.h"
+
+namespace emulator {
+
+ParallelScheduler::ParallelScheduler (int nPartitions)
+  : m_nextEventTimes (nPartitions, 0)
+  , m_lastEventTimes (nPartitions, 0)
+  , m_isWokenUp (nPartitions, 0)
+  , m_lookahead (1)
+  , m_barrier (nPartitions)
+  , m_isStopRequested (false)
+  , m_isStopping (false)
+{
+  for (int i = 0; i < nPartitions; i++)
+    {
+      boost::shared_ptr<boost::asio::io_service> ioService =
+        boost::make_shared<boost::asio::io_service> ();
+      boost::shared_ptr<Scheduler> scheduler =
+        boost::make_shared<Scheduler> (boost::ref (*ioService), true, 1);
+
+      // All partitions share the same virtual time origin
+      scheduler->m_partitionId = i;
+      if (i > 0)
+        {
+          scheduler->m_origin = m_partitions[0]->m_origin;
+          scheduler->m_logOrigin = m_partitions[0]->m_logOrigin;
+        }
+
+      m_ioServices.push_back (ioService);
+      m_partitions.push_back (scheduler);
+    }
+}
+
+void
+ParallelScheduler::SetLookahead (int64_t lookahead)
+{
+  // Windows must make progress even on extremely fast links
+  m_lookahead = std::max<int64_t> (lookahead, 1);
+}
+
+void
+ParallelScheduler::Run ()
+{
+  NDNEM_LOG_INFO ("[ParallelScheduler::Run] " << m_partitions.size ()
+                  << " partitions, lookahead = " << m_lookahead << " us");
+
+  m_isStopRequested = false;
+
+  boost::thread_group workers;
+  for (std::size_t i = 1; i < m_partitions.size (); i++)
+    workers.create_thread (boost::bind (&ParallelScheduler::RunPartition, this, i));
+
+  this->RunPartition (0); // This call will block
+  workers.join_all ();
+}
+
+void
+ParallelScheduler::Stop ()
+{
+  boost::mutex::scoped_lock lock (m_stopMutex);
+  m_isStopRequested = true;
+
+  // Partitions may be waiting for input
+  for (std::size_t i = 0; i < m_ioServices.size (); i++)
+    m_ioServices[i]->post (boost::bind (&ParallelScheduler::WakeUp, this, i));
+}
+
+void
+ParallelScheduler::RunPartition (int i)
+{
+  Scheduler& lp = *m_partitions[i];
+  lp.SetLogClock ();
+
+  while (true)
+    {
+      // Take in the frames sent by other partitions in the previous
+      // window and the input from the apps at the current time
+      lp.DeliverRemoteEvents ();
+      lp.RunUntil (lp.m_now);
+      m_nextEventTimes[i] = lp.GetNextEventTime ();
+      m_lastEventTimes[i] = lp.m_lastEventTime;
+
+      if (i == 0)
+        {
+          boost::mutex::scoped_lock lock (m_stopMutex);
+          m_isStopping = m_isStopRequested;
+        }
+
+      m_barrier.wait ();
+
+      if (m_isStopping)
+        break;
+
+      // Every partition computes the same window from the same data
+      int64_t next = *std::min_element (m_nextEventTimes.begin (),
+                                        m_nextEventTimes.end ());
+      if (next == std::numeric_limits<int64_t>::max ())
+        {
+          // The whole network is idle. Wait for input from the apps
+          // without advancing the virtual clock. The clock goes back
+          // from the end of the last window to the last event of the
+          // network, where a single partition would be waiting.
+          lp.m_now = *std::max_element (m_lastEventTimes.begin (),
+                                        m_lastEventTimes.end ());
+          this->WaitForInput (i);
+        }
+      else
+        lp.RunUntil (next + m_lookahead);
+
+      m_barrier.wait ();
+    }
+}
+
+void
+ParallelScheduler::WaitForInput (int i)
+{
+  boost::asio::io_service& ioService = *m_ioServices[i];
+  m_isWokenUp[i] = false;
+  {
+    // Keep waiting even if the partition has no app to listen to
+    boost::asio::io_service::work work (ioService);
+    ioService.reset ();
+    ioService.run_one ();
+  }
+  if (m_isWokenUp[i])
+    return;
+
+  // The input may have scheduled events. The other partitions,
+  // still blocked, have to compute the next window with us.
+  for (std::size_t j = 0; j < m_ioServices.size (); j++)
+    {
+      if (j != static_cast<std::size_t> (i))
+        m_ioServices[j]->post (boost::bind (&ParallelScheduler::WakeUp, this, j));
+    }
+}
+
+void
+ParallelScheduler::WakeUp (int i)
+{
+  m_isWokenUp[i] = true;
+}
+
+} // namespace emulator
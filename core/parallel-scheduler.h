@@ -0,0 +1,88 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __PARALLEL_SCHEDULER_H__
+#define __PARALLEL_SCHEDULER_H__
+
+#include <boost/asio.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace emulator {
+
+/*
+ * Conservative parallel discrete-event engine for virtual-time runs.
+ *
+ * Nodes are split into partitions (logical processes). Each partition has
+ * its own io_service and virtual-time scheduler and is run by its own
+ * thread. The partitions advance in lock step through synchronization
+ * windows [T, T + lookahead), where T is the earliest pending event in the
+ * whole network and the lookahead is the shortest time from the start of
+ * a frame to the time its receivers detect it (propagation delay plus the
+ * carrier-sense time of the PHY, see Link::GetLookahead). Frames sent to
+ * another partition are exchanged at the end of each window. Since no frame
+ * is detected within the lookahead, they all fire at their own time in the
+ * receiving partition, ordered by their keys (see Scheduler::PostFrame), so
+ * that runs give the same results as with a single partition regardless of
+ * the thread interleaving.
+ */
+class ParallelScheduler : boost::noncopyable {
+public:
+  explicit
+  ParallelScheduler (int nPartitions);
+
+  int
+  GetPartitionCount () const
+  {
+    return m_partitions.size ();
+  }
+
+  Scheduler&
+  GetPartition (int i)
+  {
+    return *m_partitions.at (i);
+  }
+
+  void
+  SetLookahead (int64_t lookahead);
+
+  void
+  Run ();
+
+  void
+  Stop ();
+
+private:
+  void
+  RunPartition (int);
+
+  // Block until a handler of the partition is ready, e.g., input from the
+  // apps, and then wake up the other partitions
+  void
+  WaitForInput (int);
+
+  void
+  WakeUp (int);
+
+private:
+  std::vector<boost::shared_ptr<boost::asio::io_service> > m_ioServices;
+  std::vector<boost::shared_ptr<Scheduler> > m_partitions;
+  std::vector<int64_t> m_nextEventTimes;  // exchanged between windows
+  std::vector<int64_t> m_lastEventTimes;  // likewise
+  std::vector<char> m_isWokenUp;  // by another partition, see WaitForInput
+  int64_t m_lookahead;  // in us
+  boost::barrier m_barrier;
+
+  boost::mutex m_stopMutex;
+  bool m_isStopRequested;
+  bool m_isStopping;  // snapshot of the flag above, agreed upon by all partitions
+};
+
+} // namespace emulator
+
+#endif // __PARALLEL_SCHEDULER_H__
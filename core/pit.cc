@@ -1,5 +1,8 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
 
+#include <boost/assert.hpp>
+#include <algorithm>
+
 #include "logging.h"
 #include "pit.h"
 
@@ -10,12 +13,10 @@ bool
 PitEntry::AddNonce (const uint32_t nonce, const int faceId,
 		    boost::chrono::system_clock::time_point& expire)
 {
-  std::map<uint32_t, FaceRecord>::iterator it;
-  it = m_nonceTable.find (nonce);
-  if (it == m_nonceTable.end ())
+  if (m_nonceTable.find (nonce) == m_nonceTable.end ())
     {
       // Record nonce, incoming face id and expire time
-      m_nonceTable.insert (std::make_pair<uint32_t, FaceRecord> (nonce, FaceRecord (faceId, expire)));
+      m_nonceTable.push_back (FaceRecord (nonce, faceId, expire));
       return true;
     }
   else
@@ -23,58 +24,118 @@ PitEntry::AddNonce (const uint32_t nonce, const int faceId,
 }
 
 bool
-Pit::AddInterest (const int faceId, const boost::shared_ptr<ndn::Interest>& i)
+Pit::AddInterest (const int faceId, const boost::shared_ptr<InterestView>& i,
+                  const int hopCount)
 {
   boost::chrono::system_clock::time_point expire =
-    boost::chrono::system_clock::now () + i->getInterestLifetime ();
+    m_scheduler.Now () + i->GetInterestLifetime ();
 
-  pit_type::iterator it = m_pit.find (i->getName ());
+  pit_type::iterator it = m_pit.find (i->GetName ());
   if (it == m_pit.end ())
     {
       // No interest with the same name is in table yet
-      boost::shared_ptr<PitEntry> entry = boost::make_shared<PitEntry> (i);
-      entry->AddNonce (i->getNonce (), faceId, expire);
-      m_pit.insert (std::make_pair<ndn::Name, boost::shared_ptr<PitEntry> > (i->getName (), entry));
+      PitEntry& entry =
+        m_pit.insert (std::make_pair (i->GetName (), PitEntry (i))).first->second;
+      entry.AddNonce (i->GetNonce (), faceId, expire);
+      entry.m_hopCount = hopCount;
+      m_nameLengths[i->GetName ().size ()]++;
+      this->AddExpiry (i->GetName (), expire);
       return true;
     }
   else
     {
       // Interest with the same name already exists
-      boost::shared_ptr<PitEntry>& entry = it->second;
-      return entry->AddNonce (i->getNonce (), faceId, expire);
+      PitEntry& entry = it->second;
+      if (!entry.AddNonce (i->GetNonce (), faceId, expire))
+        return false;
+
+      entry.m_hopCount = std::max (entry.m_hopCount, hopCount);
+      this->AddExpiry (i->GetName (), expire);
+      return true;
     }
 }
 
 void
-Pit::ConsumeInterestWithDataName (const ndn::Name& name, std::set<int>& out)
+Pit::AddExpiry (const ndn::Name& name, const boost::chrono::system_clock::time_point& expire)
 {
-  boost::chrono::system_clock::time_point now =
-    boost::chrono::system_clock::now ();
+  m_expiryQueue.push (std::make_pair (expire, name));
+
+  if (!m_isCleanUpScheduled || expire < m_nextCleanUp)
+    this->ScheduleCleanUp (expire);
+}
+
+void
+Pit::ScheduleCleanUp (const boost::chrono::system_clock::time_point& t)
+{
+  long delay = static_cast<long>
+    (boost::chrono::duration_cast<boost::chrono::microseconds> (t - m_scheduler.Now ()).count ());
+
+  m_isCleanUpScheduled = true;
+  m_nextCleanUp = t;
+  m_cleanupTimer.expires_from_now (boost::posix_time::microseconds (std::max (delay, 0L)));
+  m_cleanupTimer.async_wait (boost::bind (&Pit::CleanUp, this, _1));
+}
 
-  pit_type::iterator it = m_pit.begin ();
-  while (it != m_pit.end ())
+void
+Pit::ConsumeInterestWithDataName (const ndn::Name& name, std::set<int>& out,
+                                  int& hopCount)
+{
+  hopCount = 0;
+  boost::chrono::system_clock::time_point now =
+    m_scheduler.Now ();
+
+  // Probe every prefix of the data name whose length is in use. The
+  // lengths come in increasing order, so the hash of each prefix extends
+  // that of the previous one, and no prefix name is created.
+  std::size_t hash = 0;
+  std::size_t hashed = 0;  // components in the hash
+  std::map<std::size_t, std::size_t>::iterator lit = m_nameLengths.begin ();
+  while (lit != m_nameLengths.end () && lit->first <= name.size ())
     {
-      if (it->first.isPrefixOf (name))
-	{
-	  // TODO: check selectors
-
-	  // Record incoming faces
-	  std::map<uint32_t, FaceRecord>::iterator nit;
-	  for (nit = it->second->m_nonceTable.begin ();
-	       nit != it->second->m_nonceTable.end (); nit++)
-	    {
-	      if (nit->second.expire > now)
-		out.insert (nit->second.faceId);
-	    }
-
-	  // Remove this entry from pit
-	  it = m_pit.erase (it); // this will return iterator for the next element
-	}
-      else
-	it++;
+      std::size_t length = lit->first;
+      lit++;  // Erase() may remove the current length
+
+      for (; hashed < length; hashed++)
+        {
+          ndn_name_hash::combine (hash, name[hashed]);
+        }
+
+      pit_type::iterator it = m_pit.find (ndn_name_prefix (name, length, hash),
+                                          ndn_name_prefix_hash (), ndn_name_prefix_equal ());
+      if (it == m_pit.end ())
+        continue;
+
+      // TODO: check selectors
+
+      // Record incoming faces
+      FaceRecordList::iterator nit;
+      for (nit = it->second.m_nonceTable.begin ();
+           nit != it->second.m_nonceTable.end (); nit++)
+        {
+          if (nit->expire > now)
+            out.insert (nit->faceId);
+          m_deadNonceList.Add (it->first, nit->nonce);
+        }
+
+      hopCount = std::max (hopCount, it->second.m_hopCount);
+
+      // Remove this entry from pit
+      this->Erase (it);
     }
 }
 
+Pit::pit_type::iterator
+Pit::Erase (pit_type::iterator it)
+{
+  std::map<std::size_t, std::size_t>::iterator lit =
+    m_nameLengths.find (it->first.size ());
+  BOOST_ASSERT (lit != m_nameLengths.end ());
+  if (--lit->second == 0)
+    m_nameLengths.erase (lit);
+
+  return m_pit.erase (it);
+}
+
 void
 Pit::Print ()
 {
@@ -89,13 +150,13 @@ Pit::Print ()
   for (it = m_pit.begin (); it != m_pit.end (); it++)
     {
       std::cout << "  Name = " << it->first << std::endl;
-      std::map<uint32_t, FaceRecord>::iterator nit;
-      for (nit = it->second->m_nonceTable.begin ();
-	   nit != it->second->m_nonceTable.end (); nit++)
+      FaceRecordList::iterator nit;
+      for (nit = it->second.m_nonceTable.begin ();
+	   nit != it->second.m_nonceTable.end (); nit++)
 	{
-	  std::cout << "    Nonce = " << nit->first
-		    << ", FaceId = " << nit->second.faceId
-		    << ", Expire = " << nit->second.expire << std::endl;
+	  std::cout << "    Nonce = " << nit->nonce
+		    << ", FaceId = " << nit->faceId
+		    << ", Expire = " << nit->expire << std::endl;
 	}
     }
 }
@@ -103,42 +164,51 @@ Pit::Print ()
 void
 Pit::CleanUp (const boost::system::error_code& error)
 {
+  if (error == boost::asio::error::operation_aborted)
+    return;  // rescheduled for an earlier expiry
+
   if (error)
     {
       NDNEM_LOG_ERROR ("[Pit::CleanUp] error = " << error.message ());
       return;
     }
 
+  m_isCleanUpScheduled = false;
+
   boost::chrono::system_clock::time_point now =
-    boost::chrono::system_clock::now ();
+    m_scheduler.Now ();
 
-  pit_type::iterator it = m_pit.begin ();
-  while (it != m_pit.end ())
+  while (!m_expiryQueue.empty () && m_expiryQueue.top ().first <= now)
     {
-      std::map<uint32_t, FaceRecord>::iterator nit
-	= it->second->m_nonceTable.begin ();
-      while (nit != it->second->m_nonceTable.end ())
-	{
-	  if (nit->second.expire < now)
-	    {
-	      // Already expired
-	      nit = it->second->m_nonceTable.erase (nit);
-	    }
-	  else
-	    nit++;
-	}
-
-      if (it->second->m_nonceTable.empty ())
-	{
-	  // Nonce table is empty now. Remove pending interest
-	  it = m_pit.erase (it);
-	}
-      else
-	it++;
+      pit_type::iterator it = m_pit.find (m_expiryQueue.top ().second);
+      m_expiryQueue.pop ();
+      if (it == m_pit.end ())
+        continue;  // already consumed by data
+
+      FaceRecordList& nonceTable = it->second.m_nonceTable;
+      FaceRecordList::iterator nit = nonceTable.begin ();
+      while (nit != nonceTable.end ())
+        {
+          if (nit->expire <= now)
+            {
+              // Already expired
+              m_deadNonceList.Add (it->first, nit->nonce);
+              nit = nonceTable.erase (nit);
+            }
+          else
+            nit++;
+        }
+
+      if (nonceTable.empty ())
+        {
+          // Nonce table is empty now. Remove pending interest
+          this->Erase (it);
+        }
     }
 
   // Schedule the next cleanup
-  ScheduleCleanUp ();
+  if (!m_expiryQueue.empty ())
+    this->ScheduleCleanUp (m_expiryQueue.top ().first);
 }
 
 } // namespace node
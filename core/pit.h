@@ -9,35 +9,135 @@
 #include <boost/unordered_map.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
-#include <ndn-cxx/interest.hpp>
 #include <map>
 #include <set>
+#include <queue>
+#include <vector>
 #include <iostream>
 
+#include "dead-nonce-list.h"
 #include "ndn-name-hash.h"
+#include "packet-view.h"
+#include "scheduler.h"
 
 namespace emulator {
 namespace node {
 
 class FaceRecord {
 public:
-  FaceRecord (int id, boost::chrono::system_clock::time_point& e)
-    : faceId (id)
+  FaceRecord ()
+    : nonce (0)
+    , faceId (0)
+  {
+  }
+
+  FaceRecord (uint32_t n, int id, boost::chrono::system_clock::time_point& e)
+    : nonce (n)
+    , faceId (id)
     , expire (e)
   {
   }
 
 public:
+  // The nonce of the interest
+  uint32_t nonce;
   // The id of the face where the interest comes from
   int faceId;
   // The time when the interest from this face will expire
   boost::chrono::system_clock::time_point expire;
 };
 
+/*
+ * Flat list of face records. Most interests come from one to three
+ * downstreams, which are stored inline without any heap allocation.
+ * The records move to a vector when the list grows beyond that.
+ * The order of the records is not preserved on removal.
+ */
+class FaceRecordList {
+public:
+  static const std::size_t INLINE_CAPACITY = 3;
+
+  typedef FaceRecord* iterator;
+
+  FaceRecordList ()
+    : m_size (0)
+  {
+  }
+
+  std::size_t
+  size () const
+  {
+    return m_size;
+  }
+
+  bool
+  empty () const
+  {
+    return m_size == 0;
+  }
+
+  iterator
+  begin ()
+  {
+    return m_overflow.empty () ? m_inline : &m_overflow[0];
+  }
+
+  iterator
+  end ()
+  {
+    return this->begin () + m_size;
+  }
+
+  iterator
+  find (uint32_t nonce)
+  {
+    iterator it;
+    for (it = this->begin (); it != this->end (); it++)
+      {
+        if (it->nonce == nonce)
+          break;
+      }
+    return it;
+  }
+
+  void
+  push_back (const FaceRecord& r)
+  {
+    if (m_overflow.empty () && m_size < INLINE_CAPACITY)
+      m_inline[m_size] = r;
+    else
+      {
+        if (m_overflow.empty ())
+          m_overflow.assign (m_inline, m_inline + m_size);
+        m_overflow.push_back (r);
+      }
+    m_size++;
+  }
+
+  // Replace the record with the last one. Returns the iterator
+  // to continue the traversal with.
+  iterator
+  erase (iterator it)
+  {
+    std::size_t pos = it - this->begin ();
+    *it = *(this->end () - 1);
+    if (!m_overflow.empty ())
+      m_overflow.pop_back ();
+    m_size--;
+    return this->begin () + pos;  // storage moves back inline when emptied
+  }
+
+private:
+  std::size_t m_size;
+  FaceRecord m_inline[INLINE_CAPACITY];
+  std::vector<FaceRecord> m_overflow;  // holds all records once in use
+};
+
 class PitEntry {
 public:
-  PitEntry (const boost::shared_ptr<ndn::Interest>& i)
+  PitEntry (const boost::shared_ptr<InterestView>& i)
     : m_interest (i)
+    , m_hopCount (0)
   {
   }
 
@@ -50,44 +150,72 @@ public:
   friend class Pit;
 
 private:
-  const boost::shared_ptr<ndn::Interest> m_interest;
-  std::map<uint32_t, FaceRecord> m_nonceTable;
+  boost::shared_ptr<InterestView> m_interest;
+  FaceRecordList m_nonceTable;
+  int m_hopCount;  // largest hop count of the Interests, see Packet
 };
 
 class Pit {
 public:
-  Pit (long interval, boost::asio::io_service& ioService)
-    : m_cleanupInterval (boost::posix_time::milliseconds (interval))
-    , m_cleanupTimer (ioService)
+  Pit (Scheduler& scheduler, boost::asio::io_service::strand& strand,
+       DeadNonceList& deadNonceList)
+    : m_scheduler (scheduler)
+    , m_deadNonceList (deadNonceList)
+    , m_cleanupTimer (scheduler, strand)
+    , m_isCleanUpScheduled (false)
   {
   }
 
-  typedef boost::unordered_map<ndn::Name, boost::shared_ptr<PitEntry>, ndn_name_hash> pit_type;
+  typedef boost::unordered_map<ndn::Name, PitEntry, ndn_name_hash> pit_type;
 
   bool
-  AddInterest (const int, const boost::shared_ptr<ndn::Interest>&);
+  AddInterest (const int, const boost::shared_ptr<InterestView>&, const int);
 
+  // Also returns the largest hop count of the consumed Interests
   void
-  ConsumeInterestWithDataName (const ndn::Name&, std::set<int>&);
+  ConsumeInterestWithDataName (const ndn::Name&, std::set<int>&, int&);
 
   void
   Print ();
 
+private:
+  // Pending expiry of a face record in the entry with the given name
+  typedef std::pair<boost::chrono::system_clock::time_point, ndn::Name> expiry_type;
+
+  struct ExpiryCompare {
+    bool
+    operator() (const expiry_type& a, const expiry_type& b) const
+    {
+      return a.first > b.first;  // earliest expiry on top
+    }
+  };
+
   void
-  ScheduleCleanUp ()
-  {
-    m_cleanupTimer.expires_from_now (m_cleanupInterval);
-    m_cleanupTimer.async_wait (boost::bind (&Pit::CleanUp, this, _1));
-  }
+  AddExpiry (const ndn::Name&, const boost::chrono::system_clock::time_point&);
+
+  void
+  ScheduleCleanUp (const boost::chrono::system_clock::time_point&);
 
-private:
   void
   CleanUp (const boost::system::error_code&);
 
+  pit_type::iterator
+  Erase (pit_type::iterator);
+
 private:
-  boost::unordered_map<ndn::Name, boost::shared_ptr<PitEntry>, ndn_name_hash> m_pit;
-  boost::posix_time::time_duration m_cleanupInterval;
-  boost::asio::deadline_timer m_cleanupTimer;
+  Scheduler& m_scheduler;
+  // Receives the nonces of the entries leaving the table
+  DeadNonceList& m_deadNonceList;
+  boost::unordered_map<ndn::Name, PitEntry, ndn_name_hash> m_pit;
+  // Number of entries for each name length in the table. Data lookup
+  // only probes the prefixes of the Data name with these lengths.
+  std::map<std::size_t, std::size_t> m_nameLengths;
+  // Min-heap of face record expiries. Items of entries that have been
+  // consumed in the meantime are skipped when they reach the top.
+  std::priority_queue<expiry_type, std::vector<expiry_type>, ExpiryCompare> m_expiryQueue;
+  Timer m_cleanupTimer;  // fires at the earliest expiry
+  bool m_isCleanUpScheduled;
+  boost::chrono::system_clock::time_point m_nextCleanUp;
 };
 
 } // namespace node
@@ -0,0 +1,289 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <limits>
+
+#include "logging.h"
+#include "scheduler.h"
+
+namespace emulator {
+
+const uint64_t Scheduler::TIMER_KEY = static_cast<uint64_t> (1) << 63;
+
+static void
+NoCleanUp (Scheduler*)
+{
+}
+
+// Scheduler whose virtual clock is used to timestamp log messages
+// in the current thread
+static boost::thread_specific_ptr<Scheduler> s_logScheduler (&NoCleanUp);
+
+Scheduler::Scheduler (boost::asio::io_service& ioService, bool virtualTime,
+                      int nThreads)
+  : m_ioService (ioService)
+  , m_virtualTime (virtualTime)
+  , m_nThreads (nThreads)
+  , m_isStopped (false)
+  , m_origin (boost::chrono::system_clock::now ())
+  , m_logOrigin (boost::posix_time::microsec_clock::local_time ())
+  , m_now (0)
+  , m_lastEventTime (0)
+  , m_sequence (0)
+  , m_partitionId (0)
+{
+  if (m_nThreads < 1)
+    throw std::invalid_argument ("[Scheduler::Scheduler] need at least one thread");
+
+  if (m_virtualTime && m_nThreads > 1)
+    throw std::invalid_argument ("[Scheduler::Scheduler] virtual-time mode is single threaded");
+
+  if (m_virtualTime)
+    this->SetLogClock ();
+}
+
+boost::chrono::system_clock::time_point
+Scheduler::Now () const
+{
+  if (m_virtualTime)
+    return m_origin + boost::chrono::microseconds (m_now);
+  else
+    return boost::chrono::system_clock::now ();
+}
+
+void
+Scheduler::SetLogClock ()
+{
+  s_logScheduler.reset (this);
+  __NDNEM_LOG_CLOCK__ = &Scheduler::GetLogTime;
+}
+
+boost::posix_time::ptime
+Scheduler::GetLogTime ()
+{
+  Scheduler* scheduler = s_logScheduler.get ();
+  if (scheduler == 0)
+    return boost::posix_time::microsec_clock::local_time ();
+
+  return scheduler->m_logOrigin + boost::posix_time::microseconds (scheduler->m_now);
+}
+
+void
+Scheduler::Run ()
+{
+  if (!m_virtualTime)
+    {
+      NDNEM_LOG_INFO ("[Scheduler::Run] running on " << m_nThreads << " thread(s)");
+
+      boost::thread_group workers;
+      for (int i = 1; i < m_nThreads; i++)
+        workers.create_thread (boost::bind (&Scheduler::RunWorker, this));
+
+      m_ioService.run (); // This call will block
+      workers.join_all ();
+      return;
+    }
+
+  m_isStopped = false;
+  while (!m_isStopped)
+    {
+      // Run every handler that is ready at the current virtual time,
+      // including the I/O completions on app faces. The io_service
+      // stops by itself whenever it runs out of work, so restart it.
+      m_ioService.reset ();
+      m_ioService.poll ();
+      if (m_isStopped)
+        break;
+
+      if (m_events.empty ())
+        {
+          // Nothing scheduled. Wait for input from the apps
+          // without advancing the virtual clock.
+          if (m_ioService.run_one () == 0)
+            break;  // no more work at all
+          continue;
+        }
+
+      this->FireNextEvent ();
+    }
+}
+
+void
+Scheduler::FireNextEvent ()
+{
+  // Advance the clock to the earliest event and fire it
+  std::multimap<event_key, Event>::iterator it = m_events.begin ();
+  const event_key key = it->first;
+  Event ev = it->second;
+  m_events.erase (it);
+  if (ev.timer != 0)
+    ev.timer->m_pending.erase (key);
+
+  m_now = key.first;
+  m_lastEventTime = m_now;
+  ev.handler (boost::system::error_code ());
+}
+
+int64_t
+Scheduler::GetNextEventTime () const
+{
+  if (m_events.empty ())
+    return std::numeric_limits<int64_t>::max ();
+  else
+    return m_events.begin ()->first.first;
+}
+
+void
+Scheduler::RunUntil (int64_t end)
+{
+  while (true)
+    {
+      m_ioService.reset ();
+      m_ioService.poll ();
+
+      if (this->GetNextEventTime () >= end)
+        break;
+
+      this->FireNextEvent ();
+    }
+
+  m_now = std::max (m_now, end);
+}
+
+void
+Scheduler::PostFrame (const boost::chrono::system_clock::time_point& t, uint64_t key,
+                      const handler_type& handler)
+{
+  BOOST_ASSERT (m_virtualTime);
+  this->ScheduleFrame
+    (boost::chrono::duration_cast<boost::chrono::microseconds> (t - m_origin).count (),
+     key, handler);
+}
+
+void
+Scheduler::PostRemote (const boost::chrono::system_clock::time_point& t, uint64_t key,
+                       const handler_type& handler)
+{
+  BOOST_ASSERT (m_virtualTime);
+  int64_t time =
+    boost::chrono::duration_cast<boost::chrono::microseconds> (t - m_origin).count ();
+  RemoteEvent ev = { time, key, handler };
+
+  boost::mutex::scoped_lock lock (m_inboxMutex);
+  m_inbox.push_back (ev);
+}
+
+void
+Scheduler::DeliverRemoteEvents ()
+{
+  std::vector<RemoteEvent> inbox;
+  {
+    boost::mutex::scoped_lock lock (m_inboxMutex);
+    inbox.swap (m_inbox);
+  }
+
+  // The keys order the events, whatever the interleaving of the partition threads
+  std::vector<RemoteEvent>::iterator it;
+  for (it = inbox.begin (); it != inbox.end (); it++)
+    {
+      BOOST_ASSERT (it->time >= m_now);
+      this->ScheduleFrame (it->time, it->key, it->handler);
+    }
+}
+
+void
+Scheduler::Stop ()
+{
+  m_isStopped = true;
+  m_ioService.stop ();
+}
+
+Scheduler::event_key
+Scheduler::Schedule (Timer* timer, int64_t expire, const handler_type& handler)
+{
+  event_key key (std::max (expire, m_now), TIMER_KEY | m_sequence++);
+  Event ev = { timer, handler };
+  m_events.insert (std::make_pair (key, ev));
+  return key;
+}
+
+void
+Scheduler::ScheduleFrame (int64_t time, uint64_t key, const handler_type& handler)
+{
+  BOOST_ASSERT (key < TIMER_KEY);
+  Event ev = { 0, handler };
+  m_events.insert (std::make_pair (event_key (std::max (time, m_now), key), ev));
+}
+
+Scheduler::handler_type
+Scheduler::Remove (const event_key& key)
+{
+  std::multimap<event_key, Event>::iterator it = m_events.find (key);
+  BOOST_ASSERT (it != m_events.end ());
+  handler_type handler = it->second.handler;
+  m_events.erase (it);
+  return handler;
+}
+
+Timer::Timer (Scheduler& scheduler, boost::asio::io_service::strand& strand)
+  : m_scheduler (scheduler)
+  , m_strand (strand)
+  , m_timer (scheduler.GetIoService ())
+  , m_expire (0)
+{
+}
+
+Timer::~Timer ()
+{
+  this->cancel ();
+}
+
+void
+Timer::expires_from_now (const boost::posix_time::time_duration& d)
+{
+  if (!m_scheduler.IsVirtualTime ())
+    {
+      m_timer.expires_from_now (d);
+      return;
+    }
+
+  // Same as deadline_timer: pending waits are cancelled
+  this->cancel ();
+  m_expire = m_scheduler.m_now + d.total_microseconds ();
+}
+
+void
+Timer::async_wait (const Scheduler::handler_type& handler)
+{
+  if (!m_scheduler.IsVirtualTime ())
+    {
+      m_timer.async_wait (m_strand.wrap (handler));
+      return;
+    }
+
+  m_pending.insert (m_scheduler.Schedule (this, m_expire, handler));
+}
+
+std::size_t
+Timer::cancel ()
+{
+  if (!m_scheduler.IsVirtualTime ())
+    return m_timer.cancel ();
+
+  // Cancelled handlers are invoked with operation_aborted, as asio does
+  const boost::system::error_code aborted (boost::asio::error::operation_aborted);
+  std::size_t n = m_pending.size ();
+  std::set<Scheduler::event_key>::iterator it;
+  for (it = m_pending.begin (); it != m_pending.end (); it++)
+    {
+      m_scheduler.GetIoService ().post (boost::bind (m_scheduler.Remove (*it), aborted));
+    }
+  m_pending.clear ();
+  return n;
+}
+
+} // namespace emulator
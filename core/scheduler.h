@@ -0,0 +1,193 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <boost/asio.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace emulator {
+
+class Timer;
+class ParallelScheduler;
+
+/*
+ * Drives the event loop of the emulator.
+ *
+ * In real-time mode the scheduler simply runs the io_service and all timers
+ * are backed by asio deadline timers. In virtual-time mode it maintains a
+ * simulated clock and an event queue ordered by (time, key). Timers are keyed
+ * by a sequence number. Frames are keyed by their sender and come before
+ * the timers due at the same time, so that the order in which a node sees
+ * frames and timers does not depend on which partition sent the frames.
+ * Whenever there is no ready handler left in the io_service, the clock jumps
+ * to the next pending event, so that scenarios run as fast as the CPU allows
+ * while all delays are honored with exact microsecond precision.
+ *
+ * In real-time mode the io_service may be run by several worker threads.
+ * Each node then serializes its own handlers (link devices, faces, timers)
+ * on a strand, so different nodes are processed in parallel. Virtual-time
+ * mode is single threaded; for parallel runs in virtual time, several
+ * schedulers are combined as partitions of a ParallelScheduler.
+ */
+class Scheduler : boost::noncopyable {
+public:
+  typedef boost::function<void (const boost::system::error_code&)> handler_type;
+  typedef std::pair<int64_t, uint64_t> event_key;  // (time in us, frame key or timer sequence)
+
+  // Frame keys are below this bit, timer sequence numbers above
+  static const uint64_t TIMER_KEY;
+
+  Scheduler (boost::asio::io_service& ioService, bool virtualTime = false,
+             int nThreads = 1);
+
+  boost::asio::io_service&
+  GetIoService ()
+  {
+    return m_ioService;
+  }
+
+  bool
+  IsVirtualTime () const
+  {
+    return m_virtualTime;
+  }
+
+  // Current time of the emulation (virtual or wall clock)
+  boost::chrono::system_clock::time_point
+  Now () const;
+
+  // Schedule the arrival of a frame at the given time. Frames due at the
+  // same time fire in the order of their keys, which have to be unique
+  // per frame and below TIMER_KEY. Only valid in virtual-time mode.
+  void
+  PostFrame (const boost::chrono::system_clock::time_point&, uint64_t,
+             const handler_type&);
+
+  // Same as PostFrame on behalf of another partition. The event is held
+  // back until the end of the current synchronization window, which
+  // the lookahead guarantees to be no later than the given time.
+  // Can be called from any thread.
+  void
+  PostRemote (const boost::chrono::system_clock::time_point&, uint64_t,
+              const handler_type&);
+
+  void
+  Run ();
+
+  void
+  Stop ();
+
+private:
+  friend class Timer;
+  friend class ParallelScheduler;
+
+  event_key
+  Schedule (Timer*, int64_t, const handler_type&);
+
+  void
+  ScheduleFrame (int64_t, uint64_t, const handler_type&);
+
+  void
+  FireNextEvent ();
+
+  // Time of the earliest pending event, or INT64_MAX if there is none
+  int64_t
+  GetNextEventTime () const;
+
+  // Run all handlers and events that are due before the given time
+  // and then advance the clock to that time
+  void
+  RunUntil (int64_t);
+
+  void
+  DeliverRemoteEvents ();
+
+  void
+  SetLogClock ();
+
+  handler_type
+  Remove (const event_key&);
+
+  void
+  RunWorker ()
+  {
+    m_ioService.run ();
+  }
+
+  static boost::posix_time::ptime
+  GetLogTime ();
+
+private:
+  struct Event {
+    Timer* timer;  // null for events posted by other partitions
+    handler_type handler;
+  };
+
+  struct RemoteEvent {
+    int64_t time;
+    uint64_t key;  // of the frame
+    handler_type handler;
+  };
+
+  boost::asio::io_service& m_ioService;
+  const bool m_virtualTime;
+  const int m_nThreads;  // number of threads running the io_service
+  bool m_isStopped;
+
+  // Virtual-time state
+  boost::chrono::system_clock::time_point m_origin; // wall clock time of virtual time 0
+  boost::posix_time::ptime m_logOrigin;
+  int64_t m_now;  // virtual time in us since m_origin
+  int64_t m_lastEventTime;  // of the last event fired
+  uint64_t m_sequence;  // breaks ties between timers due at the same time
+  // Timer keys are unique. Frames sent to several receivers of the
+  // same partition share their key, and their order does not matter.
+  std::multimap<event_key, Event> m_events;
+
+  // Partition state, used by ParallelScheduler
+  int m_partitionId;
+  boost::mutex m_inboxMutex;
+  std::vector<RemoteEvent> m_inbox;  // events posted by other partitions
+};
+
+/*
+ * Timer with the same interface as boost::asio::deadline_timer which
+ * follows the clock of the scheduler it is attached to. The handlers
+ * are dispatched through the strand of the node owning the timer.
+ */
+class Timer : boost::noncopyable {
+public:
+  Timer (Scheduler& scheduler, boost::asio::io_service::strand& strand);
+
+  ~Timer ();
+
+  void
+  expires_from_now (const boost::posix_time::time_duration&);
+
+  void
+  async_wait (const Scheduler::handler_type&);
+
+  std::size_t
+  cancel ();
+
+private:
+  friend class Scheduler;
+
+  Scheduler& m_scheduler;
+  boost::asio::io_service::strand& m_strand;
+  boost::asio::deadline_timer m_timer;  // used in real-time mode
+  int64_t m_expire;  // used in virtual-time mode
+  std::set<Scheduler::event_key> m_pending;
+};
+
+} // namespace emulator
+
+#endif // __SCHEDULER_H__
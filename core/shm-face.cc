@@ -0,0 +1,224 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#include <boost/bind.hpp>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "shm-face.h"
+#include "node.h"
+
+namespace emulator {
+
+const std::size_t ShmFace::RING_SIZE = 1 << 20;
+const int ShmFace::RX_BATCH = 64;
+
+ShmFace::ShmFace (const int faceId, boost::shared_ptr<Node> node,
+                  boost::asio::io_service& ioService)
+  : Face (faceId, node, ioService)
+  , m_socket (ioService)
+  , m_rxEvent (ioService)
+  , m_txEvent (-1)
+  , m_segment (MAP_FAILED)
+  , m_segmentSize (2 * ShmRing::GetSize (RING_SIZE))
+{
+}
+
+ShmFace::~ShmFace ()
+{
+  // Ignore errors
+  boost::system::error_code error;
+  m_socket.close (error);
+  m_rxEvent.close (error);
+  if (m_txEvent >= 0)
+    ::close (m_txEvent);
+  if (m_segment != MAP_FAILED)
+    ::munmap (m_segment, m_segmentSize);
+}
+
+// Send the handshake with the file descriptors attached
+static bool
+SendDescriptors (int socket, uint64_t ringSize, const int* fds, std::size_t nFds)
+{
+  struct iovec iov;
+  iov.iov_base = &ringSize;
+  iov.iov_len = sizeof (ringSize);
+
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  std::memset (control, 0, sizeof (control));
+
+  struct msghdr msg;
+  std::memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE (nFds * sizeof (int));
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (nFds * sizeof (int));
+  std::memcpy (CMSG_DATA (cmsg), fds, nFds * sizeof (int));
+
+  return ::sendmsg (socket, &msg, MSG_NOSIGNAL) == static_cast<ssize_t> (sizeof (ringSize));
+}
+
+void
+ShmFace::Start ()
+{
+  std::ostringstream name;
+  name << "/ndnem-" << ::getpid () << "-" << this;
+  int shm = ::shm_open (name.str ().c_str (), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (shm < 0)
+    throw std::runtime_error ("[ShmFace::Start] cannot create shared memory: "
+                              + std::string (std::strerror (errno)));
+
+  // Only the file descriptors give access to the segment from now on
+  ::shm_unlink (name.str ().c_str ());
+  if (::ftruncate (shm, m_segmentSize) != 0)
+    {
+      ::close (shm);
+      throw std::runtime_error ("[ShmFace::Start] cannot size shared memory: "
+                                + std::string (std::strerror (errno)));
+    }
+
+  m_segment = ::mmap (0, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+  int rxEvent = ::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  m_txEvent = ::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (m_segment == MAP_FAILED || rxEvent < 0 || m_txEvent < 0)
+    {
+      ::close (shm);
+      if (rxEvent >= 0)
+        ::close (rxEvent);
+      throw std::runtime_error ("[ShmFace::Start] cannot set up shared memory: "
+                                + std::string (std::strerror (errno)));
+    }
+  m_rxEvent.assign (rxEvent);
+
+  int fds[3] = { shm, rxEvent, m_txEvent };
+  bool isSent = SendDescriptors (m_socket.native_handle (), RING_SIZE, fds, 3);
+  ::close (shm);
+  if (!isSent)
+    throw std::runtime_error ("[ShmFace::Start] handshake failed: "
+                              + std::string (std::strerror (errno)));
+
+  uint8_t* segment = static_cast<uint8_t*> (m_segment);
+  m_rxRing.reset (new ShmRing (segment, RING_SIZE));
+  m_txRing.reset (new ShmRing (segment + ShmRing::GetSize (RING_SIZE), RING_SIZE));
+  NDNEM_LOG_TRACE ("[ShmFace::Start] (" << m_nodeId << ":" << m_id
+                   << ") shared memory of " << m_segmentSize << " bytes");
+
+  // The app never writes to the socket, so this only completes when it is gone
+  m_socket.async_receive (boost::asio::buffer (m_closeBuffer), 0,
+                          m_strand.wrap (boost::bind (&ShmFace::HandleClose,
+                                                      this->shared_from_this (), _1, _2)));
+  this->ReceivePackets ();
+}
+
+void
+ShmFace::Send (boost::shared_ptr<Packet>& pkt)
+{
+  if (!m_txRing->Push (pkt->GetBytes (), pkt->GetLength ()))
+    {
+      NDNEM_LOG_INFO ("[ShmFace::Send] (" << m_nodeId << ":" << m_id
+                      << ") ring full. Drop tail");
+      return;
+    }
+
+  if (m_txRing->ShouldNotify ())
+    {
+      uint64_t one = 1;
+      if (::write (m_txEvent, &one, sizeof (one)) < 0)
+        NDNEM_LOG_ERROR ("[ShmFace::Send] (" << m_nodeId << ":" << m_id
+                         << ") cannot notify the app: " << std::strerror (errno));
+    }
+}
+
+void
+ShmFace::WaitForPackets ()
+{
+  m_rxEvent.async_read_some (boost::asio::null_buffers (),
+                             m_strand.wrap (boost::bind (&ShmFace::HandleNotify,
+                                                         this->shared_from_this (), _1)));
+}
+
+void
+ShmFace::HandleNotify (const boost::system::error_code& error)
+{
+  if (error)
+    {
+      NDNEM_LOG_TRACE ("[ShmFace::HandleNotify] (" << m_nodeId
+                       << ":" << m_id << ") error = " << error.message ());
+      return;
+    }
+
+  // Reset the eventfd
+  uint64_t count;
+  if (::read (m_rxEvent.native_handle (), &count, sizeof (count)) < 0 && errno != EAGAIN)
+    NDNEM_LOG_ERROR ("[ShmFace::HandleNotify] (" << m_nodeId << ":" << m_id
+                     << ") cannot read eventfd: " << std::strerror (errno));
+
+  this->ReceivePackets ();
+}
+
+void
+ShmFace::ReceivePackets ()
+{
+  if (!m_rxEvent.is_open ())
+    return;  // face closed
+
+  int n = 0;
+  while (n < RX_BATCH)
+    {
+      std::size_t length;
+      const uint8_t* data = m_rxRing->Front (length);
+      if (data == 0)
+        {
+          if (m_rxRing->PrepareToWait ())
+            {
+              this->WaitForPackets ();
+              return;
+            }
+          continue;  // raced with the app
+        }
+
+      // Copy the packet out, the app reuses its slot
+      ndn::Block element;
+      bool isOk = ndn::Block::fromBuffer (data, length, element);
+      m_rxRing->Pop ();
+      n++;
+      if (!isOk)
+        {
+          NDNEM_LOG_ERROR ("[ShmFace::ReceivePackets] (" << m_nodeId << ":" << m_id
+                           << ") malformed packet of " << length << " bytes");
+          continue;
+        }
+
+      // Pass message to the node
+      this->Dispatch (element);
+    }
+
+  // Let the other handlers of the node run before the rest
+  m_strand.post (boost::bind (&ShmFace::ReceivePackets, this->shared_from_this ()));
+}
+
+void
+ShmFace::HandleClose (const boost::system::error_code& error, std::size_t)
+{
+  if (error == boost::asio::error::operation_aborted)
+    return;
+
+  NDNEM_LOG_TRACE ("[ShmFace::HandleClose] (" << m_nodeId
+                   << ":" << m_id << ") error = " << error.message ());
+  // Abort the wait for packets so that the face can go away
+  boost::system::error_code ignored;
+  m_rxEvent.close (ignored);
+  m_node->RemoveFace (m_id);
+}
+
+} // namespace emulator
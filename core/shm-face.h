@@ -0,0 +1,86 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __SHM_FACE_H__
+#define __SHM_FACE_H__
+
+#include "face.h"
+#include "shm-ring.h"
+
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace emulator {
+
+/*
+ * Face to a local app over shared memory. The app connects to the shm
+ * socket of the node, and receives over it a shared memory segment with
+ * one ring per direction and an eventfd per direction to wake up the
+ * other side when it sleeps. Packets then only go through the kernel
+ * to wake up a sleeping side.
+ * The socket stays open so that the node learns when the app is gone.
+ * Pending handlers keep the face alive until the face is closed.
+ *
+ * Handshake message: the capacity of each ring as a uint64_t, with the
+ * segment, the eventfd to the node and the eventfd to the app attached
+ * as SCM_RIGHTS. The ring to the node comes first in the segment.
+ */
+class ShmFace : public Face, public boost::enable_shared_from_this<ShmFace> {
+public:
+  static const std::size_t RING_SIZE;  // in bytes, each direction
+  static const int RX_BATCH;  // packets handled before yielding
+
+  ShmFace (const int faceId, boost::shared_ptr<Node> node,
+           boost::asio::io_service& ioService);
+
+  virtual
+  ~ShmFace ();
+
+  boost::asio::local::stream_protocol::socket&
+  GetSocket ()
+  {
+    return m_socket;
+  }
+
+  // Set up the shared memory with the app connected to the socket.
+  // Throws std::runtime_error on failure.
+  void
+  Start ();
+
+  virtual bool
+  IsLocal () const
+  {
+    return true;
+  }
+
+  virtual void
+  Send (boost::shared_ptr<Packet>& pkt);
+
+private:
+  void
+  WaitForPackets ();
+
+  void
+  HandleNotify (const boost::system::error_code&);
+
+  void
+  ReceivePackets ();
+
+  void
+  HandleClose (const boost::system::error_code&, std::size_t);
+
+private:
+  boost::asio::local::stream_protocol::socket m_socket;
+  boost::asio::posix::stream_descriptor m_rxEvent;  // from the app
+  int m_txEvent;  // to the app
+  void* m_segment;
+  std::size_t m_segmentSize;
+  boost::scoped_ptr<ShmRing> m_rxRing;
+  boost::scoped_ptr<ShmRing> m_txRing;
+  uint8_t m_closeBuffer[1];
+};
+
+} // namespace emulator
+
+#endif // __SHM_FACE_H__
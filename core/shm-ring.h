@@ -0,0 +1,158 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil -*- */
+
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+namespace emulator {
+
+/*
+ * Single-producer single-consumer ring of packets in shared memory,
+ * used by the shared-memory transport between a node and a local app.
+ * Used by both the emulator and the apps, so it depends on nothing but
+ * the compiler's atomic builtins.
+ *
+ * Each record is a 32-bit length followed by the packet, 8-byte aligned.
+ * A record that does not fit before the end of the ring is written at the
+ * start, after a wrap marker. The positions only grow, and are reduced
+ * modulo the capacity, which must be a power of two.
+ *
+ * A consumer going to sleep sets the waiting flag and checks the ring once
+ * more. A producer that finds the flag set after a push clears it and
+ * wakes the consumer up, e.g., through an eventfd.
+ */
+class ShmRing {
+public:
+  struct Header {
+    uint64_t head;  // consumer position
+    char pad1[56];  // keep the positions on separate cache lines
+    uint64_t tail;  // producer position
+    char pad2[56];
+    uint32_t waiting;  // consumer asleep
+    char pad3[60];
+  };
+
+  // Size of the shared memory taken by a ring of the given capacity
+  static std::size_t
+  GetSize (std::size_t capacity)
+  {
+    return sizeof (Header) + capacity;
+  }
+
+  // The memory is expected to be zeroed when the ring is first used
+  ShmRing (void* base, std::size_t capacity)
+    : m_header (static_cast<Header*> (base))
+    , m_data (static_cast<uint8_t*> (base) + sizeof (Header))
+    , m_capacity (capacity)
+  {
+  }
+
+  // Append the concatenation of two buffers as one packet.
+  // Returns false if there is no room.
+  bool
+  Push (const uint8_t* first, std::size_t firstLength,
+        const uint8_t* second = 0, std::size_t secondLength = 0)
+  {
+    const std::size_t length = firstLength + secondLength;
+    const std::size_t size = GetRecordSize (length);
+    if (size > m_capacity)
+      return false;
+
+    uint64_t tail = m_header->tail;  // only written by us
+    uint64_t head = __atomic_load_n (&m_header->head, __ATOMIC_ACQUIRE);
+    std::size_t offset = tail & (m_capacity - 1);
+    std::size_t skip = offset + size > m_capacity ? m_capacity - offset : 0;
+    if (tail + skip + size - head > m_capacity)
+      return false;
+
+    if (skip > 0)
+      {
+        *reinterpret_cast<uint32_t*> (m_data + offset) = WRAP;
+        tail += skip;
+        offset = 0;
+      }
+
+    *reinterpret_cast<uint32_t*> (m_data + offset) = length;
+    std::memcpy (m_data + offset + RECORD_HEADER_SIZE, first, firstLength);
+    if (secondLength > 0)
+      std::memcpy (m_data + offset + RECORD_HEADER_SIZE + firstLength, second, secondLength);
+
+    // Publish the record, then look for a sleeping consumer
+    __atomic_store_n (&m_header->tail, tail + size, __ATOMIC_SEQ_CST);
+    return true;
+  }
+
+  // Whether the consumer has to be woken up after pushes. Clears the flag.
+  bool
+  ShouldNotify ()
+  {
+    return __atomic_load_n (&m_header->waiting, __ATOMIC_SEQ_CST) != 0
+      && __atomic_exchange_n (&m_header->waiting, 0, __ATOMIC_SEQ_CST) != 0;
+  }
+
+  // Oldest packet in the ring, or 0 if the ring is empty. The packet
+  // stays in the ring until Pop is called.
+  const uint8_t*
+  Front (std::size_t& length)
+  {
+    uint64_t head = m_header->head;  // only written by us
+    if (head == __atomic_load_n (&m_header->tail, __ATOMIC_ACQUIRE))
+      return 0;
+
+    // Records are aligned, so there is always room for the wrap marker
+    std::size_t offset = head & (m_capacity - 1);
+    if (*reinterpret_cast<const uint32_t*> (m_data + offset) == WRAP)
+      {
+        __atomic_store_n (&m_header->head, head + (m_capacity - offset), __ATOMIC_RELEASE);
+        offset = 0;
+      }
+
+    length = *reinterpret_cast<const uint32_t*> (m_data + offset);
+    return m_data + offset + RECORD_HEADER_SIZE;
+  }
+
+  // Drop the packet returned by Front
+  void
+  Pop ()
+  {
+    uint64_t head = m_header->head;
+    std::size_t length = *reinterpret_cast<const uint32_t*> (m_data + (head & (m_capacity - 1)));
+    __atomic_store_n (&m_header->head, head + GetRecordSize (length), __ATOMIC_RELEASE);
+  }
+
+  // Announce that the consumer is going to sleep. Returns false if
+  // packets arrived in the meantime, in which case it stays awake.
+  bool
+  PrepareToWait ()
+  {
+    __atomic_store_n (&m_header->waiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n (&m_header->tail, __ATOMIC_SEQ_CST) != m_header->head)
+      {
+        __atomic_store_n (&m_header->waiting, 0, __ATOMIC_SEQ_CST);
+        return false;
+      }
+    return true;
+  }
+
+private:
+  static const uint32_t WRAP = 0xffffffff;
+  static const std::size_t RECORD_HEADER_SIZE = 8;
+
+  static std::size_t
+  GetRecordSize (std::size_t length)
+  {
+    return (RECORD_HEADER_SIZE + length + 7) & ~static_cast<std::size_t> (7);
+  }
+
+private:
+  Header* m_header;
+  uint8_t* m_data;
+  const std::size_t m_capacity;
+};
+
+} // namespace emulator
+
+#endif // __SHM_RING_H__
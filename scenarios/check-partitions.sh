@@ -0,0 +1,65 @@
+#!/bin/sh
+#
+# Check that a partitioned virtual-time run gives the same MAC-layer trace
+# as a single-partition run: same frames, backoffs and collisions at the
+# same virtual times. Run from the top of the tree after ./waf build.
+#
+# Usage: scenarios/check-partitions.sh [partitions] [config]
+#
+# The default scenario, hidden-station, has n1 and n2 both relay to n3
+# without hearing each other, so the CSMA backoffs and collisions show
+# up in the trace.
+
+PARTITIONS=${1:-2}
+CONFIG=${2:-scenarios/hidden-station/config.xml}
+CONSUMER_SOCKET=/tmp/node0
+PRODUCER_SOCKET=/tmp/node3
+BUILD=./build
+OUT=$(mktemp -d /tmp/ndnem-check.XXXXXX)
+
+run ()
+{
+  $BUILD/ndnem --virtual-time -l trace -p $1 -c $CONFIG > $OUT/raw-$1.log 2>&1 &
+  emulator=$!
+  sleep 1
+  $BUILD/simple-producer /test/app $PRODUCER_SOCKET > /dev/null 2>&1 &
+  producer=$!
+  sleep 1
+  # One Interest, sent while the network is idle
+  $BUILD/simple-consumer 0 /test/app $CONSUMER_SOCKET > /dev/null 2>&1
+  # Let the timers of the PIT, cache and dead nonce list run out
+  sleep 2
+  kill $producer $emulator
+  wait $producer $emulator 2> /dev/null
+
+  # Timestamps relative to the start of the run, as the virtual clock
+  # starts at the wall clock time. Lines of different partitions with
+  # the same time may come in any order, so sort them.
+  grep -E '\[(Link|LinkDevice)::' $OUT/raw-$1.log | awk '
+    {
+      split ($2, t, ":")
+      us = ((t[1] * 60 + t[2]) * 60 + t[3]) * 1000000
+      if (NR == 1)
+        origin = us
+      $1 = ""
+      $2 = sprintf ("%012.0f", us - origin)
+      print
+    }' | sort > $OUT/mac-$1.log
+}
+
+run 1
+run $PARTITIONS
+
+if [ ! -s $OUT/mac-1.log ]; then
+  echo "no MAC-layer trace in $OUT/raw-1.log"
+  exit 1
+fi
+
+if cmp -s $OUT/mac-1.log $OUT/mac-$PARTITIONS.log; then
+  echo "identical traces with 1 and $PARTITIONS partitions ($(wc -l < $OUT/mac-1.log) lines)"
+  rm -r $OUT
+else
+  echo "traces differ, see $OUT"
+  diff $OUT/mac-1.log $OUT/mac-$PARTITIONS.log | head -20
+  exit 1
+fi